@@ -7,29 +7,171 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <functional>
 
 namespace BinFS
 {
 
+struct file_info
+{
+  uint64_t size;
+  uint64_t hash;
+  uint32_t crc32c;
+  std::string etag;
+  std::string mime;
+};
+
+struct file_variant
+{
+  std::string encoding;
+  std::string data;
+};
+
+struct file_entry
+{
+  std::string name;
+  std::string data;
+  file_info info;
+  std::vector<file_variant> variants;
+  std::string stored;
+  bool shared_dict;
+
+  // Bytes that end up in the output: data, or its shared-dictionary compressed form.
+  const std::string &payload() const { return shared_dict ? stored : data; }
+};
+
+// Size of an asset before and after minification.
+struct minify_result
+{
+  std::string name;
+  uint64_t before;
+  uint64_t after;
+};
+
+// Location of a path inside the interned path string table.
+struct path_ref
+{
+  uint32_t dir;
+  uint32_t dir_length;
+  uint32_t name;
+  uint32_t name_length;
+  uint32_t file;
+};
+
 class BinFS
 {
 private:
   std::string dirpath;
-  std::vector<std::pair<std::string, std::string>> files;
+  std::vector<file_entry> files;
+  std::vector<std::string> encodings;
+  std::string dictionary;
+  // Additional names for ingested files, mapped to the name they alias.
+  std::map<std::string, std::string> aliases;
+  size_t constexpr_max_size;
+  bool constexpr_index;
+  // Whether the path index goes out with the declarations rather than the
+  // definitions; decided per output by output_unit.
+  bool index_declared;
+  std::string sourcefile;
+  std::string module_name;
+  std::string cachedir;
+  size_t cache_hit_count;
+  size_t cache_miss_count;
+  bool minify_enabled;
+  // Names and directory prefixes (ending in '/') that are never minified.
+  std::vector<std::string> minify_excludes;
+  std::vector<minify_result> minified;
 
+  void open_output(std::ofstream &out, const std::string &filename, std::ios::openmode mode = std::ios::out);
   bool file_exists(const std::string &filename);
+  std::string input_path(const std::string &filename);
+  bool minify_excluded(const std::string &filename);
   std::string read_file(const std::string &filename);
+  void add_data(const std::string &filename, std::string data);
+  std::string cached_encode(const std::string &settings, const file_entry &file, const std::function<std::string()> &encode);
   std::string string_to_hex(const std::string &in);
   std::string hex_to_string(const std::string &in);
+  std::string header_name(const std::string &in);
+  std::string octal_literal(const std::string &in);
+  bool has_literal(const file_entry &file);
+  uint64_t pack_layout(std::string &index, std::vector<const std::string *> &blobs, std::vector<uint64_t> &offsets);
+  std::string intern_paths(const std::vector<std::pair<std::string, uint32_t>> &paths, std::vector<path_ref> &refs);
+  void output_view(std::ostream &out);
+  void output_index(std::ostream &out);
+  void output_path_table(std::ostream &out);
+  void output_asset_lookup(std::ostream &out);
+  void output_index_definitions(std::ostream &out);
+  void output_template_definitions(std::ostream &out);
+  void output_literals(std::ostream &out);
+  void output_info(std::ostream &out);
+  void output_info_definitions(std::ostream &out);
+  void output_codecs(std::ostream &out);
+  void output_codec_definitions(std::ostream &out);
+  void output_variants(std::ostream &out);
+  void output_encoding_definitions(std::ostream &out);
+  void output_profile(std::ostream &out);
+  void output_profile_definitions(std::ostream &out);
+  void output_dev_includes(std::ostream &out);
+  void output_dev_declarations(std::ostream &out);
+  void output_dev_definitions(std::ostream &out);
+  void output_stream_definitions(std::ostream &out);
+  void output_stats(std::ostream &out);
+  void output_stats_definitions(std::ostream &out);
+  void output_embedded_declarations(std::ostream &out);
+  void output_embedded_definitions(std::ostream &out);
+  void output_pack_declarations(std::ostream &out, const std::string &packfile);
+  void output_pack_definitions(std::ostream &out, uint64_t id, const std::vector<const std::string *> &blobs, const std::vector<uint64_t> &offsets);
+  void output_unit(std::ostream &out, std::ostream *source, const std::string &header, const std::function<void(std::ostream &)> &declare, const std::function<void(std::ostream &)> &define);
+  void output_source(std::ostream &source, const std::function<void(std::ostream &)> &define);
+  void output_module(std::ostream &out, std::ostream *source, const std::function<void(std::ostream &)> &declare, const std::function<void(std::ostream &)> &define);
 
 public:
   BinFS(std::string dirpath_ = "");
   ~BinFS();
 
+  void add_encoding(const std::string &encoding);
+  // Reuses compressed variants and shared-dictionary output from directory,
+  // keyed by content and encoder settings; set before adding files.
+  void use_cache(const std::string &directory);
+  size_t cache_hits() const;
+  size_t cache_misses() const;
+  // Minifies JSON, CSS, HTML and SVG/XML assets added from now on, except
+  // the excluded names and directories.
+  void use_minify(const std::vector<std::string> &excludes);
+  const std::vector<minify_result> &minify_report() const;
   void add_file(const std::string &filename);
+  void add_files(const std::vector<std::string> &filenames);
+  // Ingests data produced in memory under name, without touching the disk.
+  void add_buffer(const std::string &name, const std::string &data);
+  void add_buffer(const std::string &name, std::string &&data);
+  void add_alias(const std::string &alias, const std::string &target);
   void remove_file(const std::string &filename);
+  // Keeps only the named files, in the given order.
+  void order_files(const std::vector<std::string> &filenames);
+  void apply_profile(const std::string &filename);
+  void use_shared_dictionary(size_t max_size);
+  void use_constexpr_contents(size_t max_size);
+  // Keeps the path index and BINFS_ASSET in the header when the definitions
+  // go to a source file; implied by constexpr contents.
+  void use_constexpr_index(bool enabled);
+  void use_source_file(const std::string &filename);
+  // Emits a C++20 module interface unit named name instead of a header; the
+  // definitions go to the source file, which becomes the implementation unit.
+  void use_module(const std::string &name);
   std::string get_file(const std::string &filename);
+  // Writes the generated header to out. With source the definitions go there
+  // instead, behind an #include of header.
+  void output_hpp(std::ostream &out, std::ostream *source = nullptr, const std::string &header = "binfs.hpp");
+  void output_hpp(int fd);
   void output_hpp_file(const std::string &filename);
+  // Writes the pack to pack and its header to out; packfile is the path the
+  // runtime maps by default. Unseekable streams get the padding written out.
+  void output_pack(std::ostream &pack, std::ostream &out, const std::string &packfile, std::ostream *source = nullptr, const std::string &header = "binfs.hpp");
+  void output_pack(int pack_fd, int fd, const std::string &packfile);
+  void output_pack_file(const std::string &packfile, const std::string &hppfile);
 };
 
 } // BinFS
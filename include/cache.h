@@ -0,0 +1,17 @@
+#ifndef _BINFS_CACHE_H_
+#define _BINFS_CACHE_H_
+
+#include <string>
+
+namespace BinFS
+{
+
+// Content-addressed store of encoded fragments: one file per key under
+// directory, written through a rename so concurrent jobs sharing the
+// directory never read a partial fragment. Keys must be safe file names.
+bool cache_load(const std::string &directory, const std::string &key, std::string &fragment);
+void cache_store(const std::string &directory, const std::string &key, const std::string &fragment);
+
+} // BinFS
+
+#endif // _BINFS_CACHE_H_
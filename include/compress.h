@@ -0,0 +1,19 @@
+#ifndef _BINFS_COMPRESS_H_
+#define _BINFS_COMPRESS_H_
+
+#include <string>
+
+namespace BinFS
+{
+
+bool encoding_supported(const std::string &encoding);
+bool is_compressible(const std::string &mime);
+std::string compress(const std::string &encoding, const std::string &in);
+std::string deflate_with_dictionary(const std::string &in, const std::string &dictionary);
+// Encoder, level and library version behind an encoding ("dict" for shared
+// dictionary deflate). Cached output is only reused under the same settings.
+std::string encoder_settings(const std::string &encoding);
+
+} // BinFS
+
+#endif // _BINFS_COMPRESS_H_
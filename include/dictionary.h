@@ -0,0 +1,14 @@
+#ifndef _BINFS_DICTIONARY_H_
+#define _BINFS_DICTIONARY_H_
+
+#include <string>
+#include <vector>
+
+namespace BinFS
+{
+
+std::string train_dictionary(const std::vector<const std::string *> &samples, size_t max_size);
+
+} // BinFS
+
+#endif // _BINFS_DICTIONARY_H_
@@ -0,0 +1,38 @@
+#ifndef _BINFS_FDSTREAM_H_
+#define _BINFS_FDSTREAM_H_
+
+#include <cstdio>
+#include <streambuf>
+#include <vector>
+
+namespace BinFS
+{
+
+// Output stream buffer over a file descriptor the caller owns. Seeking works
+// when the descriptor supports it (regular files), and fails like any
+// unseekable stream otherwise (pipes, sockets, terminals).
+class fd_buffer : public std::streambuf
+{
+private:
+  int fd;
+  std::vector<char> buffer;
+
+  bool flush_buffer();
+
+protected:
+  int_type overflow(int_type c) override;
+  std::streamsize xsputn(const char *s, std::streamsize n) override;
+  int sync() override;
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+public:
+  explicit fd_buffer(int fd_);
+  ~fd_buffer();
+  fd_buffer(const fd_buffer &) = delete;
+  fd_buffer &operator=(const fd_buffer &) = delete;
+};
+
+} // BinFS
+
+#endif // _BINFS_FDSTREAM_H_
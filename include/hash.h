@@ -0,0 +1,16 @@
+#ifndef _BINFS_HASH_H_
+#define _BINFS_HASH_H_
+
+#include <string>
+#include <cstdint>
+
+namespace BinFS
+{
+
+uint64_t xxh64(const char *data, size_t len, uint64_t seed = 0);
+uint32_t crc32c(const char *data, size_t len, uint32_t crc = 0);
+std::string strong_etag(uint64_t hash);
+
+} // BinFS
+
+#endif // _BINFS_HASH_H_
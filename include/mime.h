@@ -0,0 +1,13 @@
+#ifndef _BINFS_MIME_H_
+#define _BINFS_MIME_H_
+
+#include <string>
+
+namespace BinFS
+{
+
+std::string guess_mime_type(const std::string &filename);
+
+} // BinFS
+
+#endif // _BINFS_MIME_H_
@@ -0,0 +1,20 @@
+#ifndef _BINFS_MINIFY_H_
+#define _BINFS_MINIFY_H_
+
+#include <string>
+
+namespace BinFS
+{
+
+// Whether filename has an extension with a minifier: .json, .webmanifest,
+// .css, .html, .htm, .svg and .xml.
+bool can_minify(const std::string &filename);
+// Strips what the format does not need: insignificant whitespace, comments
+// and trailing semicolons. Content that must stay verbatim (strings,
+// attribute values, <pre>, <textarea>, <script>, <style>, CDATA) is kept.
+// Returns in unchanged for other files and for JSON with an unclosed string.
+std::string minify(const std::string &filename, const std::string &in);
+
+} // BinFS
+
+#endif // _BINFS_MINIFY_H_
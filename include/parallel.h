@@ -0,0 +1,20 @@
+#ifndef _BINFS_PARALLEL_H_
+#define _BINFS_PARALLEL_H_
+
+#include <cstddef>
+#include <functional>
+
+namespace BinFS
+{
+
+// Number of worker threads used by parallel_for; 0 selects one per core.
+void set_jobs(size_t jobs);
+size_t jobs();
+
+// Runs fn(0) ... fn(count - 1) on up to jobs() threads and returns when all
+// calls are done. The first exception thrown by a call is rethrown.
+void parallel_for(size_t count, const std::function<void(size_t)> &fn);
+
+} // BinFS
+
+#endif // _BINFS_PARALLEL_H_
@@ -0,0 +1,17 @@
+#ifndef _BINFS_READER_H_
+#define _BINFS_READER_H_
+
+#include <string>
+#include <vector>
+
+namespace BinFS
+{
+
+// Reads every path into contents[i]. On Linux the opens, size queries, reads
+// and closes are batched through io_uring when the kernel allows it; anything
+// else falls back to one std::ifstream per file.
+void read_files(const std::vector<std::string> &paths, std::vector<std::string> &contents);
+
+} // BinFS
+
+#endif // _BINFS_READER_H_
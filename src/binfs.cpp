@@ -1,22 +1,156 @@
 #include "binfs.h"
+#include "hash.h"
+#include "mime.h"
+#include "compress.h"
+#include "dictionary.h"
+#include "reader.h"
+#include "parallel.h"
+#include "fdstream.h"
+#include "cache.h"
+#include "minify.h"
+
+#include <cctype>
+#include <cstring>
 
 namespace BinFS
 {
 
-BinFS::BinFS(std::string dirpath_) : dirpath(dirpath_){};
+// Layout of the external pack file, mirrored by the generated runtime: a
+// fixed header, the index (files followed by their encoded variants) and the
+// payload. Blobs of a page or more start on a page boundary so they can be
+// mapped and prefetched independently; smaller blobs are packed back to back
+// without crossing a page boundary, so each costs at most one page fault and
+// neighbours in the layout order share pages.
+static const char pack_magic[] = "BINFSPK1";
+static const uint32_t pack_version = 2;
+static const uint64_t pack_header_size = 64;
+static const uint64_t pack_alignment = 4096;
+
+static void put_u32(std::string &out, uint32_t v)
+{
+  for (int i = 0; i < 4; ++i)
+  {
+    out.push_back(static_cast<char>((v >> (i * 8)) & 0xff));
+  }
+}
+
+static void put_u64(std::string &out, uint64_t v)
+{
+  put_u32(out, static_cast<uint32_t>(v));
+  put_u32(out, static_cast<uint32_t>(v >> 32));
+}
+
+// zlib only looks back 32 KiB, which bounds a useful preset dictionary.
+static const size_t shared_dictionary_size = 32 * 1024;
+
+static bool is_absolute(const std::string &path)
+{
+  return !path.empty() && (path[0] == '/' || (path.length() > 1 && path[1] == ':'));
+}
+
+static uint64_t align_up(uint64_t v, uint64_t alignment)
+{
+  return (v + alignment - 1) / alignment * alignment;
+}
+
+// Shorter zero runs are cheaper to embed than to describe.
+static const uint64_t zero_run_min = 256;
+
+// Offsets and sizes of the zero runs of at least zero_run_min bytes in data.
+static std::vector<std::pair<uint64_t, uint64_t>> find_zero_runs(const std::string &data)
+{
+  std::vector<std::pair<uint64_t, uint64_t>> runs;
+  size_t pos = 0;
+  while (data.length() > pos)
+  {
+    size_t begin = data.find('\0', pos);
+    if (begin == std::string::npos)
+    {
+      break;
+    }
+    size_t end = data.find_first_not_of('\0', begin);
+    end = end == std::string::npos ? data.length() : end;
+    if (end - begin >= zero_run_min)
+    {
+      runs.push_back(std::make_pair(begin, end - begin));
+    }
+    pos = end;
+  }
+
+  return runs;
+}
+
+// data without the given runs, which the runtime puts back.
+static std::string remove_runs(const std::string &data, const std::vector<std::pair<uint64_t, uint64_t>> &runs)
+{
+  if (runs.empty())
+  {
+    return data;
+  }
+  std::string kept;
+  size_t pos = 0;
+  for (const std::pair<uint64_t, uint64_t> &run : runs)
+  {
+    kept.append(data, pos, static_cast<size_t>(run.first) - pos);
+    pos = static_cast<size_t>(run.first + run.second);
+  }
+  kept.append(data, pos, std::string::npos);
+
+  return kept;
+}
+
+// Writes blob at offset from base, seeking over every aligned page that is
+// entirely zero so the filesystem can leave a hole there instead of
+// allocating it.
+static void write_sparse(std::ostream &out, std::streamoff base, uint64_t offset, const std::string &blob)
+{
+  size_t pos = 0;
+  while (blob.length() > pos)
+  {
+    size_t length = std::min<size_t>(blob.length() - pos, static_cast<size_t>(pack_alignment - (offset + pos) % pack_alignment));
+    if (length != pack_alignment || blob.find_first_not_of('\0', pos) < pos + length)
+    {
+      out.seekp(base + static_cast<std::streamoff>(offset + pos));
+      out.write(blob.data() + pos, length);
+    }
+    pos += length;
+  }
+}
+
+BinFS::BinFS(std::string dirpath_) : dirpath(dirpath_), constexpr_max_size(0), constexpr_index(false), index_declared(true), cache_hit_count(0), cache_miss_count(0), minify_enabled(false){};
 
 BinFS::~BinFS(){};
 
+void BinFS::open_output(std::ofstream &out, const std::string &filename, std::ios::openmode mode)
+{
+  out.open(filename, mode);
+  if (!out.is_open())
+  {
+    throw std::runtime_error("cannot write " + filename);
+  }
+}
+
 bool BinFS::file_exists(const std::string &filename)
 {
   std::ifstream file(filename.c_str());
   return file.good();
 }
 
+// Where an ingested name is read from: relative to dirpath, while absolute
+// names given without a root are read as they are.
+std::string BinFS::input_path(const std::string &filename)
+{
+  if (dirpath == "" && !filename.empty() && filename[0] == '/')
+  {
+    return filename;
+  }
+
+  return (dirpath == "" ? "./" : dirpath + "/") + filename;
+}
+
 std::string BinFS::read_file(const std::string &filename)
 {
-  dirpath = dirpath == "" ? "./" : dirpath + "/";
-  std::string filepath(dirpath + filename);
+  std::string filepath(input_path(filename));
   if (!file_exists(filepath))
   {
     throw std::runtime_error(filepath + " does not exists!");
@@ -41,15 +175,23 @@ std::string BinFS::read_file(const std::string &filename)
 
 std::string BinFS::string_to_hex(const std::string &in)
 {
-  std::stringstream ss;
+  static const char digits[] = "0123456789abcdef";
+  static const size_t slice = 1 << 20;
+  std::string output(in.length() * 2, '\0');
 
-  ss << std::hex << std::setfill('0');
-  for (size_t i = 0; in.length() > i; ++i)
-  {
-    ss << std::setw(2) << static_cast<unsigned int>(static_cast<unsigned char>(in[i]));
-  }
+  // Every byte maps to a fixed output position, so large inputs are encoded
+  // in slices on the thread pool without any stitching.
+  parallel_for((in.length() + slice - 1) / slice, [&](size_t s) {
+    size_t end = in.length() < (s + 1) * slice ? in.length() : (s + 1) * slice;
+    for (size_t i = s * slice; end > i; ++i)
+    {
+      unsigned char c = static_cast<unsigned char>(in[i]);
+      output[2 * i] = digits[c >> 4];
+      output[2 * i + 1] = digits[c & 15];
+    }
+  });
 
-  return ss.str();
+  return output;
 }
 
 std::string BinFS::hex_to_string(const std::string &in)
@@ -76,20 +218,329 @@ std::string BinFS::hex_to_string(const std::string &in)
   return output;
 }
 
+// Quoted header names are not string literals: escapes are taken verbatim,
+// so names that would need one (or could form a trigraph) are refused.
+std::string BinFS::header_name(const std::string &in)
+{
+  for (char c : in)
+  {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (c == '"' || u < 0x20 || u > 0x7e)
+    {
+      throw std::runtime_error(in + " cannot be named in an #include!");
+    }
+  }
+  if (in.find("??") != std::string::npos)
+  {
+    throw std::runtime_error(in + " cannot be named in an #include!");
+  }
+
+  return in;
+}
+
+// Escapes everything outside printable ASCII as three-digit octal, so the
+// literal is exact for binary data and no escape can swallow the next byte.
+std::string BinFS::octal_literal(const std::string &in)
+{
+  std::ostringstream output;
+  for (char c : in)
+  {
+    unsigned char u = static_cast<unsigned char>(c);
+    if (c == '"' || c == '\\' || c == '?')
+    {
+      output << '\\' << c;
+    }
+    else if (u < 0x20 || u > 0x7e)
+    {
+      output << '\\' << std::oct << std::setw(3) << std::setfill('0') << static_cast<unsigned>(u) << std::dec;
+    }
+    else
+    {
+      output << c;
+    }
+  }
+
+  return output.str();
+}
+
+void BinFS::add_encoding(const std::string &encoding)
+{
+  if (!encoding_supported(encoding))
+  {
+    throw std::runtime_error(encoding + " encoding is not supported by this build!");
+  }
+
+  encodings.push_back(encoding);
+}
+
 void BinFS::add_file(const std::string &filename)
 {
-  std::string data = read_file(filename);
-  std::string hexdata = string_to_hex(data);
+  add_data(filename, read_file(filename));
+}
+
+void BinFS::add_files(const std::vector<std::string> &filenames)
+{
+  // Read in slices so only one slice of raw contents is held besides the
+  // already ingested files.
+  const size_t slice = 4096;
+  for (size_t begin = 0; filenames.size() > begin; begin += slice)
+  {
+    std::vector<std::string> names(filenames.begin() + begin, filenames.begin() + std::min(filenames.size(), begin + slice));
+    std::vector<std::string> paths;
+    for (const std::string &name : names)
+    {
+      paths.push_back(input_path(name));
+    }
+    std::vector<std::string> contents;
+    read_files(paths, contents);
+    for (size_t i = 0; names.size() > i; ++i)
+    {
+      add_data(names[i], std::move(contents[i]));
+    }
+  }
+}
+
+void BinFS::use_cache(const std::string &directory)
+{
+  cachedir = directory;
+}
+
+size_t BinFS::cache_hits() const
+{
+  return cache_hit_count;
+}
+
+size_t BinFS::cache_misses() const
+{
+  return cache_miss_count;
+}
+
+// Runs encode, or reuses its output from the cache directory. The key covers
+// the encoder settings and the content (hash, checksum and size), never the
+// file name, so renamed and duplicated assets hit too.
+std::string BinFS::cached_encode(const std::string &settings, const file_entry &file, const std::function<std::string()> &encode)
+{
+  if (cachedir == "")
+  {
+    return encode();
+  }
+
+  std::string key = settings + "-" + strong_etag(file.info.hash).substr(1, 16) + strong_etag(file.info.crc32c).substr(9, 8) + "-" + std::to_string(file.info.size);
+  std::string fragment;
+  if (cache_load(cachedir, key, fragment))
+  {
+    cache_hit_count++;
+    return fragment;
+  }
+  fragment = encode();
+  cache_store(cachedir, key, fragment);
+  cache_miss_count++;
+  return fragment;
+}
+
+void BinFS::use_minify(const std::vector<std::string> &excludes)
+{
+  minify_enabled = true;
+  minify_excludes = excludes;
+}
+
+const std::vector<minify_result> &BinFS::minify_report() const
+{
+  return minified;
+}
+
+bool BinFS::minify_excluded(const std::string &filename)
+{
+  for (const std::string &exclude : minify_excludes)
+  {
+    bool directory = !exclude.empty() && exclude.back() == '/';
+    if (filename == exclude || (directory && filename.compare(0, exclude.length(), exclude) == 0))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void BinFS::add_buffer(const std::string &name, const std::string &data)
+{
+  add_data(name, data);
+}
+
+void BinFS::add_buffer(const std::string &name, std::string &&data)
+{
+  add_data(name, std::move(data));
+}
+
+void BinFS::add_data(const std::string &filename, std::string data)
+{
+  if (minify_enabled && can_minify(filename) && !minify_excluded(filename))
+  {
+    std::string small = minify(filename, data);
+    if (small.length() < data.length())
+    {
+      minified.push_back(minify_result{filename, data.length(), small.length()});
+      data = std::move(small);
+    }
+  }
+
+  file_entry file;
+  file.name = filename;
+  file.data = std::move(data);
+  file.info.size = file.data.length();
+  file.info.hash = xxh64(file.data.data(), file.data.length());
+  file.info.crc32c = crc32c(file.data.data(), file.data.length());
+  file.info.etag = strong_etag(file.info.hash);
+  file.info.mime = guess_mime_type(filename);
+  file.shared_dict = false;
+  if (is_compressible(file.info.mime))
+  {
+    for (const std::string &encoding : encodings)
+    {
+      file_variant variant;
+      variant.encoding = encoding;
+      variant.data = cached_encode(encoder_settings(encoding), file, [&]() { return compress(encoding, file.data); });
+      if (variant.data.length() < file.data.length())
+      {
+        file.variants.push_back(std::move(variant));
+      }
+    }
+  }
+
+  files.push_back(std::move(file));
+}
+
+void BinFS::apply_profile(const std::string &filename)
+{
+  std::ifstream in(filename);
+  if (!in.is_open())
+  {
+    throw std::runtime_error(filename + " does not exists!");
+  }
+
+  // Lines are "rank hits path" in first-access order; accessed files move to
+  // the front in that order, everything else keeps its relative position.
+  std::map<std::string, size_t> ranks;
+  std::string line;
+  while (std::getline(in, line))
+  {
+    std::istringstream ss(line);
+    uint64_t rank = 0, hits = 0;
+    std::string path;
+    if (ss >> rank >> hits && std::getline(ss >> std::ws, path))
+    {
+      // Profiles from older generators may name a file by one of its aliases.
+      std::map<std::string, std::string>::const_iterator alias = aliases.find(path);
+      ranks.insert(std::make_pair(alias == aliases.end() ? path : alias->second, static_cast<size_t>(rank)));
+    }
+  }
+
+  std::stable_sort(files.begin(), files.end(), [&ranks](const file_entry &a, const file_entry &b) {
+    std::map<std::string, size_t>::const_iterator ra = ranks.find(a.name), rb = ranks.find(b.name);
+    if (rb == ranks.end())
+    {
+      return ra != ranks.end();
+    }
+    return ra != ranks.end() && ra->second < rb->second;
+  });
+}
+
+void BinFS::use_constexpr_contents(size_t max_size)
+{
+  constexpr_max_size = max_size;
+}
+
+void BinFS::use_constexpr_index(bool enabled)
+{
+  constexpr_index = enabled;
+}
+
+void BinFS::use_module(const std::string &name)
+{
+  bool start = true;
+  for (char c : name)
+  {
+    bool letter = std::isalpha(static_cast<unsigned char>(c)) || c == '_';
+    if (!(letter || (!start && (std::isdigit(static_cast<unsigned char>(c)) || c == '.'))))
+    {
+      throw std::runtime_error(name + " is not a valid module name!");
+    }
+    start = c == '.';
+  }
+  if (start && name != "")
+  {
+    throw std::runtime_error(name + " is not a valid module name!");
+  }
+  module_name = name;
+}
+
+void BinFS::use_source_file(const std::string &filename)
+{
+  sourcefile = filename;
+}
+
+void BinFS::use_shared_dictionary(size_t max_size)
+{
+  std::vector<const std::string *> samples;
+  for (file_entry &file : files)
+  {
+    file.stored.clear();
+    file.shared_dict = false;
+    if (!file.data.empty() && file.data.length() <= max_size)
+    {
+      samples.push_back(&file.data);
+    }
+  }
+
+  dictionary = train_dictionary(samples, shared_dictionary_size);
+  if (dictionary.empty())
+  {
+    return;
+  }
+
+  std::string dictionary_settings = encoder_settings("dict") + "-" + strong_etag(xxh64(dictionary.data(), dictionary.length())).substr(1, 16);
+  bool used = false;
+  for (file_entry &file : files)
+  {
+    if (file.data.empty() || file.data.length() > max_size)
+    {
+      continue;
+    }
+    std::string compressed = cached_encode(dictionary_settings, file, [&]() { return deflate_with_dictionary(file.data, dictionary); });
+    if (compressed.length() < file.data.length())
+    {
+      file.stored = std::move(compressed);
+      file.shared_dict = true;
+      used = true;
+    }
+  }
+  if (!used)
+  {
+    dictionary.clear();
+  }
+}
 
-  files.emplace_back(filename, hexdata);
+void BinFS::add_alias(const std::string &alias, const std::string &target)
+{
+  aliases[alias] = target;
 }
 
 void BinFS::remove_file(const std::string &filename)
 {
+  if (aliases.erase(filename) > 0)
+  {
+    return;
+  }
+  for (auto alias = aliases.begin(); alias != aliases.end();)
+  {
+    alias = alias->second == filename ? aliases.erase(alias) : std::next(alias);
+  }
+
   auto it = files.begin();
-  for (const std::pair<std::string, std::string> &file : files)
+  for (const file_entry &file : files)
   {
-    if (file.first == filename)
+    if (file.name == filename)
     {
       files.erase(it);
       return;
@@ -98,14 +549,27 @@ void BinFS::remove_file(const std::string &filename)
   }
 }
 
+void BinFS::order_files(const std::vector<std::string> &filenames)
+{
+  std::map<std::string, size_t> order;
+  for (size_t i = 0; filenames.size() > i; ++i)
+  {
+    order.insert(std::make_pair(filenames[i], i));
+  }
+  files.erase(std::remove_if(files.begin(), files.end(), [&order](const file_entry &file) { return order.count(file.name) == 0; }), files.end());
+  std::stable_sort(files.begin(), files.end(), [&order](const file_entry &a, const file_entry &b) { return order[a.name] < order[b.name]; });
+}
+
 std::string BinFS::get_file(const std::string &filename)
 {
+  std::map<std::string, std::string>::const_iterator alias = aliases.find(filename);
+  const std::string &name = alias == aliases.end() ? filename : alias->second;
   auto it = files.begin();
-  for (const std::pair<std::string, std::string> &file : files)
+  for (const file_entry &file : files)
   {
-    if (file.first == filename)
+    if (file.name == name)
     {
-      return hex_to_string(file.second);
+      return file.data;
     }
     it++;
   }
@@ -113,75 +577,2054 @@ std::string BinFS::get_file(const std::string &filename)
   throw std::runtime_error(filename + " not found!");
 }
 
-void BinFS::output_hpp_file(const std::string &filename)
+std::string BinFS::intern_paths(const std::vector<std::pair<std::string, uint32_t>> &paths, std::vector<path_ref> &refs)
 {
-  std::ofstream out;
-  out.open(filename);
+  std::vector<std::string> dirs;
+  for (const std::pair<std::string, uint32_t> &path : paths)
+  {
+    size_t slash = path.first.find_last_of('/');
+    dirs.push_back(slash == std::string::npos ? "" : path.first.substr(0, slash + 1));
+  }
 
-  out << "#ifndef _BINFS_OUTPUT_HPP_" << std::endl;
-  out << "#define _BINFS_OUTPUT_HPP_" << std::endl;
-  out << std::endl;
-  out << "#include <string>" << std::endl;
-  out << "#include <vector>" << std::endl;
-  out << "#include <iostream>" << std::endl;
-  out << "#include <fstream>" << std::endl;
-  out << "#include <sstream>" << std::endl;
-  out << "#include <iomanip>" << std::endl;
-  out << std::endl;
-  out << "namespace BinFS" << std::endl;
-  out << "{" << std::endl;
-  out << std::endl;
-  out << "class BinFS" << std::endl;
-  out << "{" << std::endl;
-  out << "private:" << std::endl;
-  out << "  std::vector<std::pair<std::string, std::string>> files;" << std::endl;
-  out << "  std::string hex_to_string(const std::string &in)" << std::endl;
-  out << "  {" << std::endl;
-  out << "    std::string output;" << std::endl;
-  out << "    if ((in.length() % 2) != 0)" << std::endl;
-  out << "    {" << std::endl;
-  out << "      throw std::runtime_error(\"string is not valid length!\");" << std::endl;
-  out << "    }" << std::endl;
-  out << "    size_t cnt = in.length() / 2;" << std::endl;
-  out << "    for (size_t i = 0; cnt > i; ++i)" << std::endl;
-  out << "    {" << std::endl;
-  out << "      uint32_t s = 0;" << std::endl;
-  out << "      std::stringstream ss;" << std::endl;
-  out << "      ss << std::hex << in.substr(i * 2, 2);" << std::endl;
-  out << "      ss >> s;" << std::endl;
-  out << "      output.push_back(static_cast<unsigned char>(s));" << std::endl;
-  out << "    }" << std::endl;
-  out << "    return output;" << std::endl;
-  out << "  }" << std::endl;
-  out << "public:" << std::endl;
-  out << "  BinFS() {};" << std::endl;
-  out << "  ~BinFS() {};" << std::endl;
-  out << "  std::string get_file(const std::string &filename)" << std::endl;
-  out << "  {" << std::endl;
-  out << "    auto it = files.begin();" << std::endl;
-  out << "    for (const std::pair<std::string, std::string> &file : files)" << std::endl;
-  out << "    {" << std::endl;
-  out << "      if (file.first == filename)" << std::endl;
-  out << "      {" << std::endl;
-  out << "        return hex_to_string(file.second);" << std::endl;
-  out << "      }" << std::endl;
-  out << "      it++;" << std::endl;
-  out << "    }" << std::endl;
-  out << "    throw std::runtime_error(filename + \" not found!\");" << std::endl;
-  out << "  }" << std::endl;
-  out << "  void init()" << std::endl;
-  out << "  {" << std::endl;
-  for (const std::pair<std::string, std::string> &file : files)
+  // Directories sharing a prefix sort next to each other, so a directory that
+  // prefixes its successor can point into the successor's bytes.
+  std::vector<std::string> unique_dirs(dirs);
+  std::sort(unique_dirs.begin(), unique_dirs.end());
+  unique_dirs.erase(std::unique(unique_dirs.begin(), unique_dirs.end()), unique_dirs.end());
+
+  std::string strings;
+  std::map<std::string, uint32_t> dir_offsets;
+  for (size_t i = unique_dirs.size(); i > 0; --i)
   {
-    out << "    files.emplace_back(\"" << file.first << "\",\"" << file.second << "\");" << std::endl;
+    const std::string &dir = unique_dirs[i - 1];
+    if (unique_dirs.size() > i && unique_dirs[i].compare(0, dir.length(), dir) == 0)
+    {
+      dir_offsets[dir] = dir_offsets[unique_dirs[i]];
+      continue;
+    }
+    dir_offsets[dir] = static_cast<uint32_t>(strings.length());
+    strings += dir;
   }
-  out << "  }" << std::endl;
-  out << "};" << std::endl;
-  out << std::endl;
-  out << "} // BinFS" << std::endl;
-  out << std::endl;
-  out << "#endif // _BINFS_OUTPUT_HPP_" << std::endl;
-  out << std::endl;
+
+  std::map<std::string, uint32_t> name_offsets;
+  for (size_t i = 0; paths.size() > i; ++i)
+  {
+    std::string name = paths[i].first.substr(dirs[i].length());
+    std::map<std::string, uint32_t>::iterator it = name_offsets.find(name);
+    if (it == name_offsets.end())
+    {
+      it = name_offsets.insert(std::make_pair(name, static_cast<uint32_t>(strings.length()))).first;
+      strings += name;
+    }
+
+    path_ref ref;
+    ref.dir = dir_offsets[dirs[i]];
+    ref.dir_length = static_cast<uint32_t>(dirs[i].length());
+    ref.name = it->second;
+    ref.name_length = static_cast<uint32_t>(name.length());
+    ref.file = paths[i].second;
+    refs.push_back(ref);
+  }
+
+  return strings;
+}
+
+// Literals are opt-in: without -constexpr-max not even empty assets get one.
+bool BinFS::has_literal(const file_entry &file)
+{
+  return constexpr_max_size > 0 && file.data.length() <= constexpr_max_size;
+}
+
+void BinFS::output_literals(std::ostream &out)
+{
+  if (constexpr_max_size == 0)
+  {
+    return;
+  }
+
+  out << "// Raw contents of an asset, usable in constant expressions." << std::endl;
+  out << "struct literal" << std::endl;
+  out << "{" << std::endl;
+  out << "  const char *data;" << std::endl;
+  out << "  size_t size;" << std::endl;
+  out << std::endl;
+  out << "  constexpr char operator[](size_t i) const { return data[i]; }" << std::endl;
+  out << "  constexpr const char *begin() const { return data; }" << std::endl;
+  out << "  constexpr const char *end() const { return data + size; }" << std::endl;
+  out << "#if __cplusplus >= 201703L" << std::endl;
+  out << "  constexpr std::string_view str() const { return std::string_view(data, size); }" << std::endl;
+  out << "#endif" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "// Assets up to " << constexpr_max_size << " bytes are also emitted as literals; larger ones have a" << std::endl;
+  out << "// null entry." << std::endl;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    if (!has_literal(files[i]))
+    {
+      continue;
+    }
+    out << "static constexpr char asset_literal_" << i << "[] =" << std::endl;
+    for (size_t pos = 0; files[i].data.length() > pos; pos += 96)
+    {
+      out << "  \"" << octal_literal(files[i].data.substr(pos, 96)) << "\"" << std::endl;
+    }
+    out << "  \"\";" << std::endl;
+  }
+  out << "static constexpr literal asset_literals[] = {" << std::endl;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    if (!has_literal(files[i]))
+    {
+      out << "  {nullptr, 0}," << std::endl;
+    }
+    else
+    {
+      out << "  {asset_literal_" << i << ", " << files[i].data.length() << "}," << std::endl;
+    }
+  }
+  out << "  {nullptr, 0}" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "// Not constexpr, so using a path above the threshold fails to compile." << std::endl;
+  out << "inline size_t asset_not_literal(const char *path)" << std::endl;
+  out << "{" << std::endl;
+  out << "  throw std::runtime_error(std::string(path) + \" is not available as a literal!\");" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "constexpr size_t literal_row(size_t row, const char *path)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return asset_literals[path_table<>::index[row].file].data != nullptr ? row : asset_not_literal(path);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "template <size_t Row>" << std::endl;
+  out << "constexpr literal make_literal()" << std::endl;
+  out << "{" << std::endl;
+  out << "  return asset_literals[path_table<>::index[Row].file];" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Contents of a small asset as a constant expression, e.g." << std::endl;
+  out << "// constexpr BinFS::literal schema = BINFS_ASSET_DATA(\"data/schema.json\");" << std::endl;
+  out << "#define BINFS_ASSET_DATA(path) (::BinFS::make_literal< ::BinFS::literal_row(::BinFS::asset_path(path), path)>())" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_stream_definitions(std::ostream &out)
+{
+  out << "// Opens the asset as a read-only stdio stream over the stored bytes, for C" << std::endl;
+  out << "// libraries that only take a FILE*. The stream must not outlive this object." << std::endl;
+  out << "// Windows has no fmemopen, so there the bytes are copied to a tmpfile()." << std::endl;
+  out << "inline FILE *BinFS::open_file(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return open_file(lookup(filename));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline FILE *BinFS::open_file(handle h) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  view data = get_view(h);" << std::endl;
+  out << "#if defined(_WIN32)" << std::endl;
+  out << "  FILE *file = tmpfile();" << std::endl;
+  out << "  if (file != nullptr && (std::fwrite(data.data(), 1, data.size(), file) != data.size() || std::fseek(file, 0, SEEK_SET) != 0))" << std::endl;
+  out << "  {" << std::endl;
+  out << "    std::fclose(file);" << std::endl;
+  out << "    file = nullptr;" << std::endl;
+  out << "  }" << std::endl;
+  out << "#else" << std::endl;
+  out << "  // fmemopen may reject an empty buffer, and an empty asset reads like /dev/null." << std::endl;
+  out << "  FILE *file = data.size() == 0 ? std::fopen(\"/dev/null\", \"rb\") : fmemopen(const_cast<char *>(data.data()), data.size(), \"rb\");" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  if (file == nullptr)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"cannot open \" + path_name(path_table<>::index[h.path]));" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return file;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "#if defined(__linux__)" << std::endl;
+  out << "// Returns a sealed memfd holding a copy of the asset, usable with sendfile," << std::endl;
+  out << "// splice or APIs that want a real descriptor. The caller closes it." << std::endl;
+  out << "inline int BinFS::memfd(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return memfd(lookup(filename));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline int BinFS::memfd(handle h) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  view data = get_view(h);" << std::endl;
+  out << "  std::string name = path_name(path_table<>::index[h.path]).substr(0, 200);" << std::endl;
+  out << "  int fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);" << std::endl;
+  out << "  if (fd < 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"cannot create memfd for \" + name);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  size_t written = 0;" << std::endl;
+  out << "  while (data.size() > written)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    ssize_t n = write(fd, data.data() + written, data.size() - written);" << std::endl;
+  out << "    if (n <= 0)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      close(fd);" << std::endl;
+  out << "      throw std::runtime_error(\"cannot write memfd for \" + name);" << std::endl;
+  out << "    }" << std::endl;
+  out << "    written += static_cast<size_t>(n);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  if (lseek(fd, 0, SEEK_SET) != 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    close(fd);" << std::endl;
+  out << "    throw std::runtime_error(\"cannot seal memfd for \" + name);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return fd;" << std::endl;
+  out << "}" << std::endl;
+  out << "#endif" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_template_definitions(std::ostream &out)
+{
+  out << "// Calls fn(path, is_dir) for every direct child of dir. The walk itself is" << std::endl;
+  out << "// not a template, so the header does not need the path index." << std::endl;
+  out << "template <typename F>" << std::endl;
+  out << "inline void BinFS::for_each_in_dir(const std::string &dir, F fn) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  visit_dir(dir, [](void *context, const std::string &path, bool is_dir) { (*static_cast<F *>(context))(path, is_dir); }, &fn);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_embedded_declarations(std::ostream &out)
+{
+  out << "#include <string>" << std::endl;
+  out << "#include <vector>" << std::endl;
+  out << "#include <algorithm>" << std::endl;
+  out << "#include <cstring>" << std::endl;
+  out << "#include <iostream>" << std::endl;
+  out << "#include <fstream>" << std::endl;
+  out << "#include <sstream>" << std::endl;
+  out << "#include <iomanip>" << std::endl;
+  out << "#include <cstdint>" << std::endl;
+  out << "#include <cstdlib>" << std::endl;
+  out << "#include <cctype>" << std::endl;
+  out << "#include <memory>" << std::endl;
+  out << "#include <mutex>" << std::endl;
+  out << "#include <stdexcept>" << std::endl;
+  out << "#include <atomic>" << std::endl;
+  out << "#include <chrono>" << std::endl;
+  out << "#include <cstdio>" << std::endl;
+  out << "#include <sys/stat.h>" << std::endl;
+  out << "#if defined(__linux__)" << std::endl;
+  out << "#include <fcntl.h>" << std::endl;
+  out << "#include <unistd.h>" << std::endl;
+  out << "#include <sys/mman.h>" << std::endl;
+  out << "#endif" << std::endl;
+  if (constexpr_max_size > 0)
+  {
+    out << "#if __cplusplus >= 201703L" << std::endl;
+    out << "#include <string_view>" << std::endl;
+    out << "#endif" << std::endl;
+  }
+  if (!dictionary.empty())
+  {
+    out << "#include <zlib.h>" << std::endl;
+  }
+  output_dev_includes(out);
+  out << "namespace BinFS" << std::endl;
+  out << "{" << std::endl;
+  out << std::endl;
+  output_view(out);
+  output_index(out);
+  output_literals(out);
+  output_stats(out);
+  out << "class BinFS" << std::endl;
+  out << "{" << std::endl;
+  out << "private:" << std::endl;
+  out << "  std::vector<std::string> files;" << std::endl;
+  out << "  std::vector<std::string> variants;" << std::endl;
+  out << "  mutable std::vector<std::unique_ptr<std::string>> cache;" << std::endl;
+  out << "  mutable std::mutex cache_mutex;" << std::endl;
+  out << "  mutable usage_counters counters;" << std::endl;
+  out << std::endl;
+  out << "  static std::string hex_to_string(const std::string &in);" << std::endl;
+  out << "  static std::string restore_zero_runs(size_t i, const std::string &bytes);" << std::endl;
+  out << "  bool all_zero(size_t i) const;" << std::endl;
+  out << "  static bool accepts_encoding(const std::string &accept, const std::string &coding);" << std::endl;
+  out << "  static const path_entry *lower_bound(const std::string &key);" << std::endl;
+  out << "  static void visit_dir(const std::string &dir, void (*visit)(void *, const std::string &, bool), void *context);" << std::endl;
+  out << "  static handle lookup(const std::string &filename);" << std::endl;
+  out << "  void track(size_t i) const;" << std::endl;
+  out << "  std::string inflate_file(size_t i, const char *data, size_t size) const;" << std::endl;
+  out << "  view decode(size_t slot) const;" << std::endl;
+  out << "  view load_variant(size_t v) const;" << std::endl;
+  out << "  void count_decode(size_t bytes, std::chrono::steady_clock::time_point start) const;" << std::endl;
+  out << "  void count_cached(size_t bytes) const;" << std::endl;
+  out << "  void storage_stats(usage_stats &s) const;" << std::endl;
+  output_dev_declarations(out);
+  out << "public:" << std::endl;
+  out << "  BinFS() {};" << std::endl;
+  out << "  ~BinFS() {};" << std::endl;
+  out << "  std::string get_file(const std::string &filename);" << std::endl;
+  out << "  std::string get_file(handle h);" << std::endl;
+  out << "  view get_view(const std::string &filename) const;" << std::endl;
+  out << "  view get_view(handle h) const;" << std::endl;
+  out << "  const file_info &get_info(const std::string &filename) const;" << std::endl;
+  out << "  const file_info &get_info(handle h) const;" << std::endl;
+  out << "  std::vector<std::string> list(const std::string &prefix) const;" << std::endl;
+  out << "  template <typename F>" << std::endl;
+  out << "  void for_each_in_dir(const std::string &dir, F fn) const;" << std::endl;
+  out << "  encoded get_encoded(const std::string &filename, const std::string &accept_encoding) const;" << std::endl;
+  out << "  encoded get_encoded(handle h, const std::string &accept_encoding) const;" << std::endl;
+  out << "  void prefetch(const std::string &filename) const;" << std::endl;
+  out << "  void prefetch_all() const;" << std::endl;
+  out << "  usage_stats stats() const;" << std::endl;
+  out << "  std::string metrics() const;" << std::endl;
+  out << "  FILE *open_file(const std::string &filename) const;" << std::endl;
+  out << "  FILE *open_file(handle h) const;" << std::endl;
+  out << "#if defined(__linux__)" << std::endl;
+  out << "  int memfd(const std::string &filename) const;" << std::endl;
+  out << "  int memfd(handle h) const;" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  void init();" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  output_template_definitions(out);
+  out << "} // BinFS" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_embedded_definitions(std::ostream &out)
+{
+  out << "namespace BinFS" << std::endl;
+  out << "{" << std::endl;
+  out << std::endl;
+  if (!index_declared)
+  {
+    output_path_table(out);
+  }
+  output_info(out);
+  output_codecs(out);
+  output_variants(out);
+  output_profile(out);
+  std::vector<std::vector<std::pair<uint64_t, uint64_t>>> holes(files.size());
+  uint64_t zero_size = 0;
+  uint32_t hole_count = 0;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    holes[i] = find_zero_runs(files[i].payload());
+    uint64_t stored = files[i].payload().length();
+    for (const std::pair<uint64_t, uint64_t> &hole : holes[i])
+    {
+      stored -= hole.second;
+    }
+    if (stored == 0 && !holes[i].empty() && !files[i].shared_dict)
+    {
+      zero_size = std::max<uint64_t>(zero_size, files[i].data.length());
+    }
+  }
+  out << "struct zero_run" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint64_t offset;" << std::endl;
+  out << "  uint64_t size;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "// Zero runs cut out of the embedded bytes, grouped per file." << std::endl;
+  out << "static const uint32_t zero_run_offsets[] = {" << std::endl;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    out << "  " << hole_count << "," << std::endl;
+    hole_count += static_cast<uint32_t>(holes[i].size());
+  }
+  out << "  " << hole_count << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "static const zero_run zero_runs[] = {" << std::endl;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    for (const std::pair<uint64_t, uint64_t> &hole : holes[i])
+    {
+      out << "  {" << hole.first << ", " << hole.second << "}," << std::endl;
+    }
+  }
+  out << "  {0, 0}" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "// Backs the views of assets that are entirely zero. It is zero-initialized," << std::endl;
+  out << "// so it lands in .bss and takes no space in the binary." << std::endl;
+  out << "static char zero_bytes[" << std::max<uint64_t>(zero_size, 1) << "];" << std::endl;
+  out << std::endl;
+  uint64_t static_bytes = 0;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    const file_entry &file = files[i];
+    static_bytes += 2 * file.payload().length() + (has_literal(file) ? file.data.length() : 0);
+    for (const std::pair<uint64_t, uint64_t> &hole : holes[i])
+    {
+      static_bytes -= 2 * hole.second;
+    }
+    for (const file_variant &variant : file.variants)
+    {
+      static_bytes += 2 * variant.data.length();
+    }
+  }
+  out << "// Hex literals read by init()" << (constexpr_max_size > 0 ? ", plus constexpr literals." : ".") << std::endl;
+  out << "static const uint64_t static_bytes = " << static_bytes << "ULL;" << std::endl;
+  out << std::endl;
+  out << "inline std::string BinFS::hex_to_string(const std::string &in)" << std::endl;
+  out << "{" << std::endl;
+  out << "  std::string output;" << std::endl;
+  out << "  if ((in.length() % 2) != 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"string is not valid length!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  size_t cnt = in.length() / 2;" << std::endl;
+  out << "  for (size_t i = 0; cnt > i; ++i)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    uint32_t s = 0;" << std::endl;
+  out << "    std::stringstream ss;" << std::endl;
+  out << "    ss << std::hex << in.substr(i * 2, 2);" << std::endl;
+  out << "    ss >> s;" << std::endl;
+  out << "    output.push_back(static_cast<unsigned char>(s));" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return output;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline std::string BinFS::restore_zero_runs(size_t i, const std::string &bytes)" << std::endl;
+  out << "{" << std::endl;
+  out << "  if (zero_run_offsets[i] == zero_run_offsets[i + 1])" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return bytes;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  size_t size = bytes.size();" << std::endl;
+  out << "  for (uint32_t r = zero_run_offsets[i]; zero_run_offsets[i + 1] > r; ++r)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    size += static_cast<size_t>(zero_runs[r].size);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  std::string output(size, '\\0');" << std::endl;
+  out << "  size_t in = 0, pos = 0;" << std::endl;
+  out << "  for (uint32_t r = zero_run_offsets[i]; zero_run_offsets[i + 1] > r; ++r)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    size_t n = static_cast<size_t>(zero_runs[r].offset) - pos;" << std::endl;
+  out << "    std::memcpy(&output[pos], bytes.data() + in, n);" << std::endl;
+  out << "    in += n;" << std::endl;
+  out << "    pos = static_cast<size_t>(zero_runs[r].offset + zero_runs[r].size);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  std::memcpy(&output[pos], bytes.data() + in, bytes.size() - in);" << std::endl;
+  out << "  return output;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Stored as nothing but zero runs and not compressed: served from zero_bytes." << std::endl;
+  out << "inline bool BinFS::all_zero(size_t i) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return file_codecs[i] == 0 && files[i].empty() && zero_run_offsets[i + 1] > zero_run_offsets[i];" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline std::string BinFS::get_file(const std::string &filename)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return get_file(lookup(filename));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline std::string BinFS::get_file(handle h)" << std::endl;
+  out << "{" << std::endl;
+  out << "  size_t i = h.file;" << std::endl;
+  out << "  track(i);" << std::endl;
+  out << "#ifdef BINFS_DEV_OVERLAY" << std::endl;
+  out << "  view dev;" << std::endl;
+  out << "  if (dev_lookup(path_name(path_table<>::index[h.path]), dev))" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return dev.str();" << std::endl;
+  out << "  }" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  if (files.size() <= i)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"init() has not been called!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();" << std::endl;
+  out << "  std::string bytes = restore_zero_runs(i, hex_to_string(files[i]));" << std::endl;
+  out << "  if (file_codecs[i] != 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    bytes = inflate_file(i, bytes.data(), bytes.size());" << std::endl;
+  out << "  }" << std::endl;
+  out << "  count_decode(bytes.size(), start);" << std::endl;
+  out << "  counters.copied_bytes.fetch_add(bytes.size(), std::memory_order_relaxed);" << std::endl;
+  out << "  return bytes;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Decoded copies are kept in cache so views stay valid for the lifetime of" << std::endl;
+  out << "// the object; get_file keeps returning a fresh copy and does not populate it." << std::endl;
+  out << "inline view BinFS::decode(size_t slot) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  if (files.size() + variants.size() <= slot)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"init() has not been called!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  if (files.size() > slot && all_zero(slot))" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return view(zero_bytes, static_cast<size_t>(file_infos[slot].size));" << std::endl;
+  out << "  }" << std::endl;
+  out << "  {" << std::endl;
+  out << "    std::lock_guard<std::mutex> lock(cache_mutex);" << std::endl;
+  out << "    if (cache.size() > slot && cache[slot])" << std::endl;
+  out << "    {" << std::endl;
+  out << "      return view(cache[slot]->data(), cache[slot]->size());" << std::endl;
+  out << "    }" << std::endl;
+  out << "  }" << std::endl;
+  out << "  // Decoding runs unlocked so other assets stay available meanwhile; when" << std::endl;
+  out << "  // threads race on one asset, the first copy published is kept." << std::endl;
+  out << "  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();" << std::endl;
+  out << "  std::string bytes = files.size() > slot ? restore_zero_runs(slot, hex_to_string(files[slot])) : hex_to_string(variants[slot - files.size()]);" << std::endl;
+  out << "  if (files.size() > slot && file_codecs[slot] != 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    bytes = inflate_file(slot, bytes.data(), bytes.size());" << std::endl;
+  out << "  }" << std::endl;
+  out << "  count_decode(bytes.size(), start);" << std::endl;
+  out << "  std::lock_guard<std::mutex> lock(cache_mutex);" << std::endl;
+  out << "  if (cache.size() <= slot)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    cache.resize(files.size() + variants.size());" << std::endl;
+  out << "  }" << std::endl;
+  out << "  if (!cache[slot])" << std::endl;
+  out << "  {" << std::endl;
+  out << "    count_cached(bytes.size());" << std::endl;
+  out << "    cache[slot].reset(new std::string(std::move(bytes)));" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return view(cache[slot]->data(), cache[slot]->size());" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline view BinFS::get_view(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return get_view(lookup(filename));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline view BinFS::get_view(handle h) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  size_t i = h.file;" << std::endl;
+  out << "  track(i);" << std::endl;
+  out << "#ifdef BINFS_DEV_OVERLAY" << std::endl;
+  out << "  view dev;" << std::endl;
+  out << "  if (dev_lookup(path_name(path_table<>::index[h.path]), dev))" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return dev;" << std::endl;
+  out << "  }" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  return decode(i);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline view BinFS::load_variant(size_t v) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return decode(files.size() + v);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// The embedded data is copied to the heap by init(), so warming an asset" << std::endl;
+  out << "// means decoding it into the cache ahead of the first get_view." << std::endl;
+  out << "inline void BinFS::prefetch(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  size_t i = lookup(filename).file;" << std::endl;
+  out << "  decode(i);" << std::endl;
+  out << "  for (size_t v = variant_offsets[i]; variant_offsets[i + 1] > v; ++v)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    decode(files.size() + v);" << std::endl;
+  out << "  }" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline void BinFS::prefetch_all() const" << std::endl;
+  out << "{" << std::endl;
+  out << "  for (size_t slot = 0; files.size() + variants.size() > slot; ++slot)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    decode(slot);" << std::endl;
+  out << "  }" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  output_index_definitions(out);
+  output_info_definitions(out);
+  output_codec_definitions(out);
+  output_encoding_definitions(out);
+  output_profile_definitions(out);
+  output_dev_definitions(out);
+  output_stream_definitions(out);
+  output_stats_definitions(out);
+  out << "inline void BinFS::storage_stats(usage_stats &s) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  for (const std::string &file : files)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    s.init_bytes += file.size();" << std::endl;
+  out << "  }" << std::endl;
+  out << "  for (const std::string &variant : variants)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    s.init_bytes += variant.size();" << std::endl;
+  out << "  }" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline void BinFS::init()" << std::endl;
+  out << "{" << std::endl;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    out << "  files.emplace_back(\"" << string_to_hex(remove_runs(files[i].payload(), holes[i])) << "\");" << std::endl;
+  }
+  for (const file_entry &file : files)
+  {
+    for (const file_variant &variant : file.variants)
+    {
+      out << "  variants.emplace_back(\"" << string_to_hex(variant.data) << "\");" << std::endl;
+    }
+  }
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "} // BinFS" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_pack_declarations(std::ostream &out, const std::string &packfile)
+{
+  out << "#include <string>" << std::endl;
+  out << "#include <fstream>" << std::endl;
+  out << "#include <sstream>" << std::endl;
+  out << "#include <vector>" << std::endl;
+  out << "#include <memory>" << std::endl;
+  out << "#include <mutex>" << std::endl;
+  out << "#include <algorithm>" << std::endl;
+  out << "#include <cstring>" << std::endl;
+  out << "#include <cstdint>" << std::endl;
+  out << "#include <cstdlib>" << std::endl;
+  out << "#include <cctype>" << std::endl;
+  out << "#include <stdexcept>" << std::endl;
+  out << "#include <atomic>" << std::endl;
+  out << "#include <chrono>" << std::endl;
+  out << "#include <cstdio>" << std::endl;
+  out << "#include <sys/stat.h>" << std::endl;
+  if (constexpr_max_size > 0)
+  {
+    out << "#if __cplusplus >= 201703L" << std::endl;
+    out << "#include <string_view>" << std::endl;
+    out << "#endif" << std::endl;
+  }
+  out << "#if defined(_WIN32)" << std::endl;
+  out << "#include <windows.h>" << std::endl;
+  out << "#else" << std::endl;
+  out << "#include <fcntl.h>" << std::endl;
+  out << "#include <unistd.h>" << std::endl;
+  out << "#include <sys/mman.h>" << std::endl;
+  out << "#endif" << std::endl;
+  if (!dictionary.empty())
+  {
+    out << "#include <zlib.h>" << std::endl;
+  }
+  output_dev_includes(out);
+  out << "#ifndef BINFS_PACK_FILE" << std::endl;
+  out << "#define BINFS_PACK_FILE \"" << octal_literal(packfile) << "\"" << std::endl;
+  out << "#endif" << std::endl;
+  out << std::endl;
+  out << "namespace BinFS" << std::endl;
+  out << "{" << std::endl;
+  out << std::endl;
+  output_view(out);
+  output_index(out);
+  output_literals(out);
+  output_stats(out);
+  out << "class BinFS" << std::endl;
+  out << "{" << std::endl;
+  out << "private:" << std::endl;
+  out << "  const char *base;" << std::endl;
+  out << "  size_t length;" << std::endl;
+  out << "  mutable std::vector<std::unique_ptr<std::string>> cache;" << std::endl;
+  out << "  mutable std::mutex cache_mutex;" << std::endl;
+  out << "  mutable usage_counters counters;" << std::endl;
+  out << std::endl;
+  out << "  static uint32_t read_u32(const char *p);" << std::endl;
+  out << "  static uint64_t read_u64(const char *p);" << std::endl;
+  out << "  static bool accepts_encoding(const std::string &accept, const std::string &coding);" << std::endl;
+  out << "  static const path_entry *lower_bound(const std::string &key);" << std::endl;
+  out << "  static void visit_dir(const std::string &dir, void (*visit)(void *, const std::string &, bool), void *context);" << std::endl;
+  out << "  static handle lookup(const std::string &filename);" << std::endl;
+  out << "  void track(size_t i) const;" << std::endl;
+  out << "  std::string inflate_file(size_t i, const char *data, size_t size) const;" << std::endl;
+  out << "  view load_variant(size_t v) const;" << std::endl;
+  out << "  void count_decode(size_t bytes, std::chrono::steady_clock::time_point start) const;" << std::endl;
+  out << "  void count_cached(size_t bytes) const;" << std::endl;
+  out << "  void storage_stats(usage_stats &s) const;" << std::endl;
+  out << "  void advise(uint64_t offset, uint64_t size) const;" << std::endl;
+  out << "  void unmap();" << std::endl;
+  output_dev_declarations(out);
+  out << std::endl;
+  out << "public:" << std::endl;
+  out << "  BinFS();" << std::endl;
+  out << "  ~BinFS();" << std::endl;
+  out << "  BinFS(const BinFS &) = delete;" << std::endl;
+  out << "  BinFS &operator=(const BinFS &) = delete;" << std::endl;
+  out << std::endl;
+  out << "  void init(const std::string &packfile = BINFS_PACK_FILE);" << std::endl;
+  out << "  view get_view(const std::string &filename) const;" << std::endl;
+  out << "  view get_view(handle h) const;" << std::endl;
+  out << "  std::string get_file(const std::string &filename) const;" << std::endl;
+  out << "  std::string get_file(handle h) const;" << std::endl;
+  out << "  const file_info &get_info(const std::string &filename) const;" << std::endl;
+  out << "  const file_info &get_info(handle h) const;" << std::endl;
+  out << "  std::vector<std::string> list(const std::string &prefix) const;" << std::endl;
+  out << "  template <typename F>" << std::endl;
+  out << "  void for_each_in_dir(const std::string &dir, F fn) const;" << std::endl;
+  out << "  encoded get_encoded(const std::string &filename, const std::string &accept_encoding) const;" << std::endl;
+  out << "  encoded get_encoded(handle h, const std::string &accept_encoding) const;" << std::endl;
+  out << "  void prefetch(const std::string &filename) const;" << std::endl;
+  out << "  void prefetch_all() const;" << std::endl;
+  out << "  usage_stats stats() const;" << std::endl;
+  out << "  std::string metrics() const;" << std::endl;
+  out << "  FILE *open_file(const std::string &filename) const;" << std::endl;
+  out << "  FILE *open_file(handle h) const;" << std::endl;
+  out << "#if defined(__linux__)" << std::endl;
+  out << "  int memfd(const std::string &filename) const;" << std::endl;
+  out << "  int memfd(handle h) const;" << std::endl;
+  out << "#endif" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  output_template_definitions(out);
+  out << "} // BinFS" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_pack_definitions(std::ostream &out, uint64_t id, const std::vector<const std::string *> &blobs, const std::vector<uint64_t> &offsets)
+{
+  out << "namespace BinFS" << std::endl;
+  out << "{" << std::endl;
+  out << std::endl;
+  if (!index_declared)
+  {
+    output_path_table(out);
+  }
+  out << "struct pack_entry" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint64_t offset;" << std::endl;
+  out << "  uint64_t size;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "static const uint64_t pack_id = " << id << "ULL;" << std::endl;
+  out << "static const size_t pack_count = " << files.size() << ";" << std::endl;
+  out << "static const size_t pack_variant_count = " << blobs.size() - files.size() << ";" << std::endl;
+  out << "static const pack_entry pack_index[] = {" << std::endl;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    out << "  {" << offsets[i] << ", " << files[i].payload().length() << "}," << std::endl;
+  }
+  out << "  {0, 0}" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "static const pack_entry pack_variants[] = {" << std::endl;
+  for (size_t i = files.size(); blobs.size() > i; ++i)
+  {
+    out << "  {" << offsets[i] << ", " << blobs[i]->length() << "}," << std::endl;
+  }
+  out << "  {0, 0}" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  output_info(out);
+  output_codecs(out);
+  output_variants(out);
+  output_profile(out);
+  uint64_t static_bytes = 0;
+  for (const file_entry &file : files)
+  {
+    static_bytes += has_literal(file) ? file.data.length() : 0;
+  }
+  out << "// Asset data lives in the pack; " << (constexpr_max_size > 0 ? "only constexpr literals are" : "none of it is") << " compiled in." << std::endl;
+  out << "static const uint64_t static_bytes = " << static_bytes << "ULL;" << std::endl;
+  out << std::endl;
+  out << "inline BinFS::BinFS() : base(nullptr), length(0) {};" << std::endl;
+  out << std::endl;
+  out << "inline BinFS::~BinFS() { unmap(); };" << std::endl;
+  out << std::endl;
+  out << "inline uint32_t BinFS::read_u32(const char *p)" << std::endl;
+  out << "{" << std::endl;
+  out << "  const unsigned char *u = reinterpret_cast<const unsigned char *>(p);" << std::endl;
+  out << "  return uint32_t(u[0]) | uint32_t(u[1]) << 8 | uint32_t(u[2]) << 16 | uint32_t(u[3]) << 24;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline uint64_t BinFS::read_u64(const char *p)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return uint64_t(read_u32(p)) | uint64_t(read_u32(p + 4)) << 32;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline void BinFS::unmap()" << std::endl;
+  out << "{" << std::endl;
+  out << "  if (base == nullptr)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return;" << std::endl;
+  out << "  }" << std::endl;
+  out << "#if defined(_WIN32)" << std::endl;
+  out << "  UnmapViewOfFile(base);" << std::endl;
+  out << "#else" << std::endl;
+  out << "  munmap(const_cast<char *>(base), length);" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  base = nullptr;" << std::endl;
+  out << "  length = 0;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline void BinFS::init(const std::string &packfile)" << std::endl;
+  out << "{" << std::endl;
+  out << "  unmap();" << std::endl;
+  out << "#if defined(_WIN32)" << std::endl;
+  out << "  HANDLE file = CreateFileA(packfile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);" << std::endl;
+  out << "  if (file == INVALID_HANDLE_VALUE)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(packfile + \" does not exists!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  LARGE_INTEGER size;" << std::endl;
+  out << "  HANDLE mapping = GetFileSizeEx(file, &size) ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;" << std::endl;
+  out << "  CloseHandle(file);" << std::endl;
+  out << "  if (mapping == NULL)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"cannot map \" + packfile);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  base = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));" << std::endl;
+  out << "  CloseHandle(mapping);" << std::endl;
+  out << "  if (base == nullptr)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"cannot map \" + packfile);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  length = static_cast<size_t>(size.QuadPart);" << std::endl;
+  out << "#else" << std::endl;
+  out << "  int fd = open(packfile.c_str(), O_RDONLY);" << std::endl;
+  out << "  if (fd < 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(packfile + \" does not exists!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  struct stat s;" << std::endl;
+  out << "  void *addr = fstat(fd, &s) == 0 ? mmap(nullptr, s.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;" << std::endl;
+  out << "  close(fd);" << std::endl;
+  out << "  if (addr == MAP_FAILED)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"cannot map \" + packfile);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  base = static_cast<const char *>(addr);" << std::endl;
+  out << "  length = static_cast<size_t>(s.st_size);" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  if (length < 64 || std::memcmp(base, \"BINFSPK1\", 8) != 0 || read_u32(base + 8) != 2 ||" << std::endl;
+  out << "      read_u32(base + 12) != pack_count || read_u64(base + 16) != pack_id || read_u64(base + 40) > length ||" << std::endl;
+  out << "      read_u32(base + 48) != pack_variant_count)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    unmap();" << std::endl;
+  out << "    throw std::runtime_error(packfile + \" does not match the generated index!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline view BinFS::get_view(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return get_view(lookup(filename));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline view BinFS::get_view(handle h) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  size_t i = h.file;" << std::endl;
+  out << "  if (base == nullptr)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"pack file is not loaded!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  track(i);" << std::endl;
+  out << "#ifdef BINFS_DEV_OVERLAY" << std::endl;
+  out << "  view dev;" << std::endl;
+  out << "  if (dev_lookup(path_name(path_table<>::index[h.path]), dev))" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return dev;" << std::endl;
+  out << "  }" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  const char *data = base + pack_index[i].offset;" << std::endl;
+  out << "  size_t size = static_cast<size_t>(pack_index[i].size);" << std::endl;
+  out << "  if (file_codecs[i] == 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return view(data, size);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  // Compressed assets are inflated once and kept for the lifetime of the" << std::endl;
+  out << "  // object. Inflating runs unlocked; when threads race on one asset, the" << std::endl;
+  out << "  // first copy published is kept." << std::endl;
+  out << "  {" << std::endl;
+  out << "    std::lock_guard<std::mutex> lock(cache_mutex);" << std::endl;
+  out << "    if (cache.size() > i && cache[i])" << std::endl;
+  out << "    {" << std::endl;
+  out << "      return view(cache[i]->data(), cache[i]->size());" << std::endl;
+  out << "    }" << std::endl;
+  out << "  }" << std::endl;
+  out << "  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();" << std::endl;
+  out << "  std::string bytes = inflate_file(i, data, size);" << std::endl;
+  out << "  count_decode(bytes.size(), start);" << std::endl;
+  out << "  std::lock_guard<std::mutex> lock(cache_mutex);" << std::endl;
+  out << "  if (cache.size() <= i)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    cache.resize(file_count);" << std::endl;
+  out << "  }" << std::endl;
+  out << "  if (!cache[i])" << std::endl;
+  out << "  {" << std::endl;
+  out << "    count_cached(bytes.size());" << std::endl;
+  out << "    cache[i].reset(new std::string(std::move(bytes)));" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return view(cache[i]->data(), cache[i]->size());" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline view BinFS::load_variant(size_t v) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  if (base == nullptr)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(\"pack file is not loaded!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return view(base + pack_variants[v].offset, static_cast<size_t>(pack_variants[v].size));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Asks the kernel to start reading the pages under a range of the mapping" << std::endl;
+  out << "// in the background; on Windows the pages are touched instead." << std::endl;
+  out << "inline void BinFS::advise(uint64_t offset, uint64_t size) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  if (base == nullptr || size == 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  // Small blobs share pages, so ranges need not start on a page boundary." << std::endl;
+  out << "  uint64_t page = offset / 4096 * 4096;" << std::endl;
+  out << "  size += offset - page;" << std::endl;
+  out << "  offset = page;" << std::endl;
+  out << "#if defined(_WIN32)" << std::endl;
+  out << "  volatile const char *p = base + offset;" << std::endl;
+  out << "  for (uint64_t o = 0; size > o; o += 4096)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    (void)p[o];" << std::endl;
+  out << "  }" << std::endl;
+  out << "#else" << std::endl;
+  out << "  posix_madvise(const_cast<char *>(base + offset), static_cast<size_t>(size), POSIX_MADV_WILLNEED);" << std::endl;
+  out << "#endif" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline void BinFS::prefetch(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  size_t i = lookup(filename).file;" << std::endl;
+  out << "  advise(pack_index[i].offset, pack_index[i].size);" << std::endl;
+  out << "  for (size_t v = variant_offsets[i]; variant_offsets[i + 1] > v; ++v)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    advise(pack_variants[v].offset, pack_variants[v].size);" << std::endl;
+  out << "  }" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline void BinFS::prefetch_all() const" << std::endl;
+  out << "{" << std::endl;
+  out << "  advise(0, length);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  output_dev_definitions(out);
+  out << "inline std::string BinFS::get_file(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return get_file(lookup(filename));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline std::string BinFS::get_file(handle h) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  view data = get_view(h);" << std::endl;
+  out << "  counters.copied_bytes.fetch_add(data.size(), std::memory_order_relaxed);" << std::endl;
+  out << "  return data.str();" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  output_index_definitions(out);
+  output_info_definitions(out);
+  output_codec_definitions(out);
+  output_encoding_definitions(out);
+  output_profile_definitions(out);
+  output_stream_definitions(out);
+  output_stats_definitions(out);
+  out << "inline void BinFS::storage_stats(usage_stats &s) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  s.mapped_bytes = length;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "} // BinFS" << std::endl;
+  out << std::endl;
+}
+
+// Writes the header guard and the declarations to out. The definitions
+// follow them, or go to source behind an #include of header; there they are
+// compiled once, so member functions lose their inline specifier and other
+// translation units link to them. With a module name out becomes a module
+// interface unit and source its implementation unit instead.
+void BinFS::output_unit(std::ostream &out, std::ostream *source, const std::string &header, const std::function<void(std::ostream &)> &declare, const std::function<void(std::ostream &)> &define)
+{
+  // A split header leaves the path index to the source file unless
+  // BINFS_ASSET is wanted, so including it costs little however many assets
+  // there are. A module interface is only compiled once and keeps it.
+  index_declared = source == nullptr || module_name != "" || constexpr_index || constexpr_max_size > 0;
+  if (module_name != "")
+  {
+    output_module(out, source, declare, define);
+    return;
+  }
+
+  out << "#ifndef _BINFS_OUTPUT_HPP_" << std::endl;
+  out << "#define _BINFS_OUTPUT_HPP_" << std::endl;
+  out << std::endl;
+  declare(out);
+  if (source == nullptr)
+  {
+    define(out);
+  }
+  else
+  {
+    size_t slash = header.find_last_of("/\\");
+    *source << "#include \"" << header_name(slash == std::string::npos ? header : header.substr(slash + 1)) << "\"" << std::endl;
+    *source << std::endl;
+    output_source(*source, define);
+  }
+  out << "#endif // _BINFS_OUTPUT_HPP_" << std::endl;
+  out << std::endl;
+}
+
+// Passes definitions through to a source file, dropping the inline specifier
+// from lines that define BinFS members. Only the start of each line is held
+// back until that is decided, so data lines of many megabytes stream
+// straight through.
+class source_filter : public std::streambuf
+{
+private:
+  static const size_t head_max = 4096;
+
+  std::ostream &out;
+  std::string head;
+  bool passing;
+
+  void flush_head()
+  {
+    if (head.compare(0, 7, "inline ") == 0 && head.find("BinFS::") != std::string::npos)
+    {
+      head.erase(0, 7);
+    }
+    out.write(head.data(), head.size());
+    passing = head.back() != '\n';
+    head.clear();
+  }
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+    {
+      char ch = traits_type::to_char_type(c);
+      xsputn(&ch, 1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(const char *s, std::streamsize n) override
+  {
+    std::streamsize pos = 0;
+    while (n > pos)
+    {
+      if (passing)
+      {
+        const char *newline = static_cast<const char *>(memchr(s + pos, '\n', n - pos));
+        std::streamsize end = newline == nullptr ? n : newline - s + 1;
+        out.write(s + pos, end - pos);
+        passing = newline == nullptr;
+        pos = end;
+      }
+      else
+      {
+        head.push_back(s[pos++]);
+        if (head.back() == '\n' || head.length() >= head_max)
+        {
+          flush_head();
+        }
+      }
+    }
+    return n;
+  }
+
+public:
+  explicit source_filter(std::ostream &out_) : out(out_), passing(false) {}
+
+  void finish()
+  {
+    if (!head.empty())
+    {
+      flush_head();
+    }
+  }
+};
+
+void BinFS::output_source(std::ostream &source, const std::function<void(std::ostream &)> &define)
+{
+  source_filter filter(source);
+  std::ostream definitions(&filter);
+  define(definitions);
+  filter.finish();
+}
+
+// The includes and configuration macros ahead of the namespace form the
+// global module fragment of both units, as macros do not cross module
+// boundaries. Everything in the namespace is exported; constexpr tables
+// become inline variables, since exported names need external linkage.
+void BinFS::output_module(std::ostream &out, std::ostream *source, const std::function<void(std::ostream &)> &declare, const std::function<void(std::ostream &)> &define)
+{
+  if (source == nullptr)
+  {
+    throw std::runtime_error("module output needs a source file for the implementation unit!");
+  }
+
+  std::ostringstream declarations;
+  declare(declarations);
+  std::string text = declarations.str();
+  size_t purview = text.find("\nnamespace BinFS\n") + 1;
+  std::string preamble = text.substr(0, purview);
+
+  out << "module;" << std::endl;
+  out << std::endl;
+  out << preamble;
+  out << "export module " << module_name << ";" << std::endl;
+  out << std::endl;
+  out << "export ";
+  std::istringstream lines(text.substr(purview));
+  std::string line;
+  while (std::getline(lines, line))
+  {
+    if (line.compare(0, 17, "static constexpr ") == 0)
+    {
+      line.replace(0, 6, "inline");
+    }
+    out << line << std::endl;
+  }
+
+  *source << "module;" << std::endl;
+  *source << std::endl;
+  *source << preamble;
+  *source << "module " << module_name << ";" << std::endl;
+  *source << std::endl;
+  output_source(*source, define);
+}
+
+void BinFS::output_stats(std::ostream &out)
+{
+  out << "// Snapshot returned by BinFS::stats(). Byte and decode counters are cumulative" << std::endl;
+  out << "// since construction; accesses lists every asset read at least once, under" << std::endl;
+  out << "// the path it was ingested as (never an alias), sorted by path." << std::endl;
+  out << "struct usage_stats" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint64_t static_bytes;       // asset data compiled into the binary" << std::endl;
+  out << "  uint64_t mapped_bytes;       // size of the mapped pack file" << std::endl;
+  out << "  uint64_t init_bytes;         // heap copies made by init()" << std::endl;
+  out << "  uint64_t cached_bytes;       // decoded copies kept alive for get_view" << std::endl;
+  out << "  uint64_t cached_assets;" << std::endl;
+  out << "  uint64_t copied_bytes;       // bytes handed out by get_file" << std::endl;
+  out << "  uint64_t decoded_bytes;      // bytes produced by decoding or inflating" << std::endl;
+  out << "  uint64_t decodes;" << std::endl;
+  out << "  uint64_t decode_nanoseconds;" << std::endl;
+  out << "  std::vector<std::pair<std::string, uint64_t>> accesses;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "// Relaxed atomic counters behind BinFS::stats(); cheap enough to stay on." << std::endl;
+  out << "struct usage_counters" << std::endl;
+  out << "{" << std::endl;
+  out << "  std::atomic<uint64_t> cached_bytes;" << std::endl;
+  out << "  std::atomic<uint64_t> cached_assets;" << std::endl;
+  out << "  std::atomic<uint64_t> copied_bytes;" << std::endl;
+  out << "  std::atomic<uint64_t> decoded_bytes;" << std::endl;
+  out << "  std::atomic<uint64_t> decodes;" << std::endl;
+  out << "  std::atomic<uint64_t> decode_nanoseconds;" << std::endl;
+  out << "  std::unique_ptr<std::atomic<uint64_t>[]> accesses;" << std::endl;
+  out << std::endl;
+  out << "  usage_counters()" << std::endl;
+  out << "      : cached_bytes(0), cached_assets(0), copied_bytes(0), decoded_bytes(0), decodes(0), decode_nanoseconds(0)," << std::endl;
+  out << "        accesses(new std::atomic<uint64_t>[" << files.size() + 1 << "]())" << std::endl;
+  out << "  {" << std::endl;
+  out << "  }" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_stats_definitions(std::ostream &out)
+{
+  out << "inline void BinFS::count_decode(size_t bytes, std::chrono::steady_clock::time_point start) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint64_t elapsed = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());" << std::endl;
+  out << "  counters.decoded_bytes.fetch_add(bytes, std::memory_order_relaxed);" << std::endl;
+  out << "  counters.decodes.fetch_add(1, std::memory_order_relaxed);" << std::endl;
+  out << "  counters.decode_nanoseconds.fetch_add(elapsed, std::memory_order_relaxed);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline void BinFS::count_cached(size_t bytes) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  counters.cached_bytes.fetch_add(bytes, std::memory_order_relaxed);" << std::endl;
+  out << "  counters.cached_assets.fetch_add(1, std::memory_order_relaxed);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline usage_stats BinFS::stats() const" << std::endl;
+  out << "{" << std::endl;
+  out << "  usage_stats s;" << std::endl;
+  out << "  s.static_bytes = static_bytes;" << std::endl;
+  out << "  s.mapped_bytes = 0;" << std::endl;
+  out << "  s.init_bytes = 0;" << std::endl;
+  out << "  storage_stats(s);" << std::endl;
+  out << "  s.cached_bytes = counters.cached_bytes.load(std::memory_order_relaxed);" << std::endl;
+  out << "  s.cached_assets = counters.cached_assets.load(std::memory_order_relaxed);" << std::endl;
+  out << "  s.copied_bytes = counters.copied_bytes.load(std::memory_order_relaxed);" << std::endl;
+  out << "  s.decoded_bytes = counters.decoded_bytes.load(std::memory_order_relaxed);" << std::endl;
+  out << "  s.decodes = counters.decodes.load(std::memory_order_relaxed);" << std::endl;
+  out << "  s.decode_nanoseconds = counters.decode_nanoseconds.load(std::memory_order_relaxed);" << std::endl;
+  out << "  for (size_t i = 0; file_count > i; ++i)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    uint64_t accesses = counters.accesses[i].load(std::memory_order_relaxed);" << std::endl;
+  out << "    if (accesses != 0)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      s.accesses.push_back(std::make_pair(path_name(path_table<>::index[path_table<>::files[i]]), accesses));" << std::endl;
+  out << "    }" << std::endl;
+  out << "  }" << std::endl;
+  out << "  std::sort(s.accesses.begin(), s.accesses.end());" << std::endl;
+  out << "  return s;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// The stats in Prometheus text exposition format." << std::endl;
+  out << "inline std::string BinFS::metrics() const" << std::endl;
+  out << "{" << std::endl;
+  out << "  usage_stats s = stats();" << std::endl;
+  out << "  std::ostringstream out;" << std::endl;
+  out << "  const char *names[] = {\"static_bytes\", \"mapped_bytes\", \"init_bytes\", \"cached_bytes\", \"cached_assets\"," << std::endl;
+  out << "                         \"copied_bytes_total\", \"decoded_bytes_total\", \"decodes_total\", \"decode_nanoseconds_total\"};" << std::endl;
+  out << "  uint64_t values[] = {s.static_bytes, s.mapped_bytes, s.init_bytes, s.cached_bytes, s.cached_assets," << std::endl;
+  out << "                       s.copied_bytes, s.decoded_bytes, s.decodes, s.decode_nanoseconds};" << std::endl;
+  out << "  for (size_t i = 0; sizeof(values) / sizeof(values[0]) > i; ++i)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    bool counter = std::strstr(names[i], \"_total\") != nullptr;" << std::endl;
+  out << "    out << \"# TYPE binfs_\" << names[i] << (counter ? \" counter\" : \" gauge\") << \"\\n\";" << std::endl;
+  out << "    out << \"binfs_\" << names[i] << \" \" << values[i] << \"\\n\";" << std::endl;
+  out << "  }" << std::endl;
+  out << "  out << \"# TYPE binfs_asset_accesses_total counter\\n\";" << std::endl;
+  out << "  for (const std::pair<std::string, uint64_t> &entry : s.accesses)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    out << \"binfs_asset_accesses_total{path=\\\"\";" << std::endl;
+  out << "    for (char c : entry.first)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      if (c == '\\\\' || c == '\"')" << std::endl;
+  out << "      {" << std::endl;
+  out << "        out << '\\\\' << c;" << std::endl;
+  out << "      }" << std::endl;
+  out << "      else if (c == '\\n')" << std::endl;
+  out << "      {" << std::endl;
+  out << "        out << \"\\\\n\";" << std::endl;
+  out << "      }" << std::endl;
+  out << "      else" << std::endl;
+  out << "      {" << std::endl;
+  out << "        out << c;" << std::endl;
+  out << "      }" << std::endl;
+  out << "    }" << std::endl;
+  out << "    out << \"\\\"} \" << entry.second << \"\\n\";" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return out.str();" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_view(std::ostream &out)
+{
+  out << "struct view" << std::endl;
+  out << "{" << std::endl;
+  out << "  const char *ptr;" << std::endl;
+  out << "  size_t len;" << std::endl;
+  out << std::endl;
+  out << "  view() : ptr(nullptr), len(0) {};" << std::endl;
+  out << "  view(const char *ptr_, size_t len_) : ptr(ptr_), len(len_) {};" << std::endl;
+  out << "  const char *data() const { return ptr; }" << std::endl;
+  out << "  size_t size() const { return len; }" << std::endl;
+  out << "  const char *begin() const { return ptr; }" << std::endl;
+  out << "  const char *end() const { return ptr + len; }" << std::endl;
+  out << "  std::string str() const { return std::string(ptr, len); }" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "struct file_info" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint64_t size;" << std::endl;
+  out << "  uint64_t hash;" << std::endl;
+  out << "  uint32_t crc32c;" << std::endl;
+  out << "  const char *etag;" << std::endl;
+  out << "  const char *mime;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "// A stored representation and its own strong ETag; variants never share" << std::endl;
+  out << "// the validator of the identity bytes." << std::endl;
+  out << "struct encoded" << std::endl;
+  out << "{" << std::endl;
+  out << "  view data;" << std::endl;
+  out << "  const char *encoding;" << std::endl;
+  out << "  const char *etag;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "struct file_variant" << std::endl;
+  out << "{" << std::endl;
+  out << "  const char *encoding;" << std::endl;
+  out << "  uint64_t size;" << std::endl;
+  out << "  const char *etag;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_index(std::ostream &out)
+{
+  out << "struct path_entry" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint32_t dir;" << std::endl;
+  out << "  uint32_t dir_length;" << std::endl;
+  out << "  uint32_t name;" << std::endl;
+  out << "  uint32_t name_length;" << std::endl;
+  out << "  uint32_t file;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "// A resolved asset: its row in the path index and the file it refers to." << std::endl;
+  out << "struct handle" << std::endl;
+  out << "{" << std::endl;
+  out << "  uint32_t path;" << std::endl;
+  out << "  uint32_t file;" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  if (index_declared)
+  {
+    output_path_table(out);
+    output_asset_lookup(out);
+  }
+}
+
+void BinFS::output_path_table(std::ostream &out)
+{
+  std::vector<std::pair<std::string, uint32_t>> paths;
+  std::map<std::string, uint32_t> ids;
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    paths.push_back(std::make_pair(files[i].name, static_cast<uint32_t>(i)));
+    ids[files[i].name] = static_cast<uint32_t>(i);
+  }
+  for (const std::pair<const std::string, std::string> &alias : aliases)
+  {
+    std::map<std::string, uint32_t>::const_iterator target = ids.find(alias.second);
+    if (target == ids.end())
+    {
+      throw std::runtime_error(alias.second + " not found!");
+    }
+    if (ids.count(alias.first) == 0)
+    {
+      paths.push_back(std::make_pair(alias.first, target->second));
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  std::vector<path_ref> refs;
+  std::string strings = intern_paths(paths, refs);
+  std::vector<uint32_t> canonical(files.size());
+  for (size_t row = 0; paths.size() > row; ++row)
+  {
+    if (paths[row].first == files[paths[row].second].name)
+    {
+      canonical[paths[row].second] = static_cast<uint32_t>(row);
+    }
+  }
+  out << "// The tables are static members of a class template, so every translation" << std::endl;
+  out << "// unit that includes them refers to the same objects." << std::endl;
+  out << "template <typename T = void>" << std::endl;
+  out << "struct path_table" << std::endl;
+  out << "{" << std::endl;
+  out << "  // All paths share one string table. Every directory is stored once (a parent" << std::endl;
+  out << "  // reuses the leading bytes of its longest descendant) and so is every distinct" << std::endl;
+  out << "  // file name; index entries only hold offsets and lengths into it." << std::endl;
+  out << "  static constexpr char strings[] =" << std::endl;
+  for (size_t i = 0; strings.length() > i; i += 96)
+  {
+    out << "    \"" << octal_literal(strings.substr(i, 96)) << "\"" << std::endl;
+  }
+  out << "    \"\";" << std::endl;
+  out << std::endl;
+  out << "  // Every path in byte-wise sorted order, so lookups and prefix queries are" << std::endl;
+  out << "  // binary searches followed by a linear scan over the matching range." << std::endl;
+  out << "  static constexpr path_entry index[] = {" << std::endl;
+  for (const path_ref &ref : refs)
+  {
+    out << "    {" << ref.dir << ", " << ref.dir_length << ", " << ref.name << ", " << ref.name_length << ", " << ref.file << "}," << std::endl;
+  }
+  out << "    {0, 0, 0, 0, 0}" << std::endl;
+  out << "  };" << std::endl;
+  out << std::endl;
+  out << "  // Row in index of the path every file was ingested under, as opposed to its" << std::endl;
+  out << "  // aliases." << std::endl;
+  out << "  static constexpr uint32_t files[] = {";
+  for (uint32_t row : canonical)
+  {
+    out << row << ", ";
+  }
+  out << "0};" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "#if __cplusplus < 201703L" << std::endl;
+  out << "template <typename T> constexpr char path_table<T>::strings[];" << std::endl;
+  out << "template <typename T> constexpr path_entry path_table<T>::index[];" << std::endl;
+  out << "template <typename T> constexpr uint32_t path_table<T>::files[];" << std::endl;
+  out << "#endif" << std::endl;
+  out << std::endl;
+  out << "static constexpr size_t path_count = " << refs.size() << ";" << std::endl;
+  out << std::endl;
+  out << "inline std::string path_name(const path_entry &entry)" << std::endl;
+  out << "{" << std::endl;
+  out << "  std::string name(path_table<>::strings + entry.dir, entry.dir_length);" << std::endl;
+  out << "  name.append(path_table<>::strings + entry.name, entry.name_length);" << std::endl;
+  out << "  return name;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Compares the path of entry with key like strcmp. With prefix set, an entry" << std::endl;
+  out << "// that starts with key compares equal." << std::endl;
+  out << "inline int path_compare(const path_entry &entry, const char *key, size_t len, bool prefix = false)" << std::endl;
+  out << "{" << std::endl;
+  out << "  const char *parts[2] = {path_table<>::strings + entry.dir, path_table<>::strings + entry.name};" << std::endl;
+  out << "  size_t lengths[2] = {entry.dir_length, entry.name_length};" << std::endl;
+  out << "  for (int p = 0; p < 2; ++p)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    size_t n = lengths[p] < len ? lengths[p] : len;" << std::endl;
+  out << "    int c = std::memcmp(parts[p], key, n);" << std::endl;
+  out << "    if (c != 0)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      return c;" << std::endl;
+  out << "    }" << std::endl;
+  out << "    if (lengths[p] > len)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      return prefix ? 0 : 1;" << std::endl;
+  out << "    }" << std::endl;
+  out << "    key += n;" << std::endl;
+  out << "    len -= n;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return len == 0 ? 0 : -1;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_asset_lookup(std::ostream &out)
+{
+  out << "// Compile-time lookup used by BINFS_ASSET. Written as single-expression" << std::endl;
+  out << "// recursion so it stays a valid C++11 constexpr function; the search depth is" << std::endl;
+  out << "// logarithmic in the number of paths." << std::endl;
+  out << "constexpr char path_char(const path_entry &entry, size_t i)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return entry.dir_length > i ? path_table<>::strings[entry.dir + i] : path_table<>::strings[entry.name + i - entry.dir_length];" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "constexpr int path_compare_at(const path_entry &entry, const char *key, size_t i)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return i == entry.dir_length + entry.name_length ? (key[i] == '\\0' ? 0 : -1)" << std::endl;
+  out << "         : key[i] == '\\0'                            ? 1" << std::endl;
+  out << "         : path_char(entry, i) != key[i]" << std::endl;
+  out << "             ? (static_cast<unsigned char>(path_char(entry, i)) < static_cast<unsigned char>(key[i]) ? -1 : 1)" << std::endl;
+  out << "             : path_compare_at(entry, key, i + 1);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "constexpr size_t path_search(const char *key, size_t lo, size_t hi)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return lo == hi ? lo" << std::endl;
+  out << "         : path_compare_at(path_table<>::index[(lo + hi) / 2], key, 0) < 0 ? path_search(key, (lo + hi) / 2 + 1, hi)" << std::endl;
+  out << "                                                                  : path_search(key, lo, (lo + hi) / 2);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Deliberately not constexpr: reaching it during constant evaluation turns an" << std::endl;
+  out << "// unknown BINFS_ASSET path into a compile error naming this function." << std::endl;
+  out << "inline size_t asset_not_found(const char *path)" << std::endl;
+  out << "{" << std::endl;
+  out << "  throw std::runtime_error(std::string(path) + \" not found!\");" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "constexpr size_t asset_path_at(size_t row, const char *path)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return path_count > row && path_compare_at(path_table<>::index[row], path, 0) == 0 ? row : asset_not_found(path);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "constexpr size_t asset_path(const char *path)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return asset_path_at(path_search(path, 0, path_count), path);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "template <size_t Row>" << std::endl;
+  out << "constexpr handle make_handle()" << std::endl;
+  out << "{" << std::endl;
+  out << "  return handle{static_cast<uint32_t>(Row), path_table<>::index[Row].file};" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Resolves a path literal to a handle at compile time, e.g." << std::endl;
+  out << "// binfs->get_view(BINFS_ASSET(\"data/index.html\")). Unknown paths fail to compile." << std::endl;
+  out << "#define BINFS_ASSET(path) (::BinFS::make_handle< ::BinFS::asset_path(path)>())" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_index_definitions(std::ostream &out)
+{
+  out << "inline const path_entry *BinFS::lower_bound(const std::string &key)" << std::endl;
+  out << "{" << std::endl;
+  out << "  return std::lower_bound(path_table<>::index, path_table<>::index + path_count, key, [](const path_entry &entry, const std::string &k) {" << std::endl;
+  out << "    return path_compare(entry, k.data(), k.length()) < 0;" << std::endl;
+  out << "  });" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline handle BinFS::lookup(const std::string &filename)" << std::endl;
+  out << "{" << std::endl;
+  out << "  const path_entry *it = lower_bound(filename);" << std::endl;
+  out << "  if (it == path_table<>::index + path_count || path_compare(*it, filename.data(), filename.length()) != 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    throw std::runtime_error(filename + \" not found!\");" << std::endl;
+  out << "  }" << std::endl;
+  out << "  handle h = {static_cast<uint32_t>(it - path_table<>::index), it->file};" << std::endl;
+  out << "  return h;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Subdirectories are reported once and skipped over with a single binary" << std::endl;
+  out << "// search each." << std::endl;
+  out << "inline void BinFS::visit_dir(const std::string &dir, void (*visit)(void *, const std::string &, bool), void *context)" << std::endl;
+  out << "{" << std::endl;
+  out << "  std::string prefix = dir.empty() || dir[dir.length() - 1] == '/' ? dir : dir + \"/\";" << std::endl;
+  out << "  const path_entry *it = lower_bound(prefix);" << std::endl;
+  out << "  while (it != path_table<>::index + path_count && path_compare(*it, prefix.data(), prefix.length(), true) == 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    std::string name = path_name(*it);" << std::endl;
+  out << "    size_t slash = name.find('/', prefix.length());" << std::endl;
+  out << "    if (slash == std::string::npos)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      visit(context, name, false);" << std::endl;
+  out << "      ++it;" << std::endl;
+  out << "      continue;" << std::endl;
+  out << "    }" << std::endl;
+  out << "    name.resize(slash);" << std::endl;
+  out << "    visit(context, name, true);" << std::endl;
+  out << "    it = lower_bound(name + static_cast<char>('/' + 1));" << std::endl;
+  out << "  }" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline std::vector<std::string> BinFS::list(const std::string &prefix) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  std::vector<std::string> names;" << std::endl;
+  out << "  for (const path_entry *it = lower_bound(prefix); it != path_table<>::index + path_count; ++it)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    if (path_compare(*it, prefix.data(), prefix.length(), true) != 0)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      break;" << std::endl;
+  out << "    }" << std::endl;
+  out << "    names.push_back(path_name(*it));" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return names;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_info(std::ostream &out)
+{
+  out << "static const size_t file_count = " << files.size() << ";" << std::endl;
+  out << "static const file_info file_infos[] = {" << std::endl;
+  for (const file_entry &file : files)
+  {
+    out << "  {" << file.info.size << ", 0x" << std::hex << file.info.hash << "ULL, 0x" << file.info.crc32c << std::dec << "U, ";
+    out << "\"" << octal_literal(file.info.etag) << "\", \"" << octal_literal(file.info.mime) << "\"}," << std::endl;
+  }
+  out << "  {0, 0, 0, nullptr, nullptr}" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_info_definitions(std::ostream &out)
+{
+  out << "inline const file_info &BinFS::get_info(const std::string &filename) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return get_info(lookup(filename));" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline const file_info &BinFS::get_info(handle h) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return file_infos[h.file];" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_codecs(std::ostream &out)
+{
+  out << "// 0: stored as is, 1: raw deflate against the bundle's shared dictionary." << std::endl;
+  out << "static const uint8_t file_codecs[] = {" << std::endl;
+  for (const file_entry &file : files)
+  {
+    out << "  " << (file.shared_dict ? 1 : 0) << "," << std::endl;
+  }
+  out << "  0" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  if (dictionary.empty())
+  {
+    return;
+  }
+  out << "static const unsigned char shared_dictionary[] = {" << std::endl;
+  for (size_t i = 0; dictionary.length() > i; i += 16)
+  {
+    out << " ";
+    for (size_t j = i; dictionary.length() > j && i + 16 > j; ++j)
+    {
+      out << " 0x" << std::hex << std::setw(2) << std::setfill('0') << static_cast<unsigned int>(static_cast<unsigned char>(dictionary[j])) << std::dec << ",";
+    }
+    out << std::endl;
+  }
+  out << "};" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_codec_definitions(std::ostream &out)
+{
+  out << "inline std::string BinFS::inflate_file(size_t i, const char *data, size_t size) const" << std::endl;
+  out << "{" << std::endl;
+  if (!dictionary.empty())
+  {
+  out << "  if (file_codecs[i] == 1)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    std::string output(static_cast<size_t>(file_infos[i].size), '\\0');" << std::endl;
+  out << "    z_stream zs = z_stream();" << std::endl;
+  out << "    if (inflateInit2(&zs, -15) != Z_OK)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      throw std::runtime_error(\"cannot initialize inflate!\");" << std::endl;
+  out << "    }" << std::endl;
+  out << "    inflateSetDictionary(&zs, shared_dictionary, sizeof(shared_dictionary));" << std::endl;
+  out << "    zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));" << std::endl;
+  out << "    zs.avail_in = static_cast<uInt>(size);" << std::endl;
+  out << "    zs.next_out = reinterpret_cast<Bytef *>(&output[0]);" << std::endl;
+  out << "    zs.avail_out = static_cast<uInt>(output.length());" << std::endl;
+  out << "    int ret = inflate(&zs, Z_FINISH);" << std::endl;
+  out << "    inflateEnd(&zs);" << std::endl;
+  out << "    if (ret != Z_STREAM_END || zs.total_out != output.length())" << std::endl;
+  out << "    {" << std::endl;
+  out << "      throw std::runtime_error(\"compressed asset is corrupt!\");" << std::endl;
+  out << "    }" << std::endl;
+  out << "    return output;" << std::endl;
+  out << "  }" << std::endl;
+  }
+  out << "  (void)data;" << std::endl;
+  out << "  (void)size;" << std::endl;
+  out << "  throw std::runtime_error(\"unknown codec \" + std::to_string(file_codecs[i]) + \"!\");" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_variants(std::ostream &out)
+{
+  out << "static const uint32_t variant_offsets[] = {" << std::endl;
+  uint32_t variant_count = 0;
+  for (const file_entry &file : files)
+  {
+    out << "  " << variant_count << "," << std::endl;
+    variant_count += static_cast<uint32_t>(file.variants.size());
+  }
+  out << "  " << variant_count << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "static const file_variant file_variants[] = {" << std::endl;
+  for (const file_entry &file : files)
+  {
+    for (const file_variant &variant : file.variants)
+    {
+      std::string etag = strong_etag(xxh64(variant.data.data(), variant.data.length()));
+      out << "  {\"" << variant.encoding << "\", " << variant.data.length() << ", \"" << octal_literal(etag) << "\"}," << std::endl;
+    }
+  }
+  out << "  {nullptr, 0, nullptr}" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_encoding_definitions(std::ostream &out)
+{
+  out << "inline bool BinFS::accepts_encoding(const std::string &accept, const std::string &coding)" << std::endl;
+  out << "{" << std::endl;
+  out << "  bool wildcard = false;" << std::endl;
+  out << "  size_t pos = 0;" << std::endl;
+  out << "  while (accept.length() > pos)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    size_t end = accept.find(',', pos);" << std::endl;
+  out << "    end = end == std::string::npos ? accept.length() : end;" << std::endl;
+  out << "    std::string item = accept.substr(pos, end - pos);" << std::endl;
+  out << "    pos = end + 1;" << std::endl;
+  out << "    size_t semi = item.find(';');" << std::endl;
+  out << "    std::string name;" << std::endl;
+  out << "    for (char c : item.substr(0, semi))" << std::endl;
+  out << "    {" << std::endl;
+  out << "      if (c != ' ' && c != '\\t')" << std::endl;
+  out << "      {" << std::endl;
+  out << "        name.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));" << std::endl;
+  out << "      }" << std::endl;
+  out << "    }" << std::endl;
+  out << "    double q = 1.0;" << std::endl;
+  out << "    size_t qpos = semi == std::string::npos ? std::string::npos : item.find(\"q=\", semi);" << std::endl;
+  out << "    if (qpos != std::string::npos)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      q = std::atof(item.c_str() + qpos + 2);" << std::endl;
+  out << "    }" << std::endl;
+  out << "    if (name == coding)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      return q > 0;" << std::endl;
+  out << "    }" << std::endl;
+  out << "    if (name == \"*\")" << std::endl;
+  out << "    {" << std::endl;
+  out << "      wildcard = q > 0;" << std::endl;
+  out << "    }" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return wildcard;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "// Returns the smallest stored representation of filename that the client" << std::endl;
+  out << "// accepts according to accept_encoding, falling back to the identity bytes." << std::endl;
+  out << "inline encoded BinFS::get_encoded(const std::string &filename, const std::string &accept_encoding) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  return get_encoded(lookup(filename), accept_encoding);" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+  out << "inline encoded BinFS::get_encoded(handle h, const std::string &accept_encoding) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  size_t i = h.file;" << std::endl;
+  out << "  size_t best = variant_offsets[i + 1];" << std::endl;
+  out << "#ifndef BINFS_DEV_OVERLAY" << std::endl;
+  out << "  uint64_t best_size = file_infos[i].size;" << std::endl;
+  out << "  for (size_t v = variant_offsets[i]; variant_offsets[i + 1] > v; ++v)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    if (best_size > file_variants[v].size && accepts_encoding(accept_encoding, file_variants[v].encoding))" << std::endl;
+  out << "    {" << std::endl;
+  out << "      best = v;" << std::endl;
+  out << "      best_size = file_variants[v].size;" << std::endl;
+  out << "    }" << std::endl;
+  out << "  }" << std::endl;
+  out << "#else" << std::endl;
+  out << "  // The overlay serves files from disk unencoded." << std::endl;
+  out << "  (void)accept_encoding;" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  encoded result;" << std::endl;
+  out << "  if (best == variant_offsets[i + 1])" << std::endl;
+  out << "  {" << std::endl;
+  out << "    result.data = get_view(h);" << std::endl;
+  out << "    result.encoding = \"identity\";" << std::endl;
+  out << "    result.etag = file_infos[i].etag;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  else" << std::endl;
+  out << "  {" << std::endl;
+  out << "    track(i);" << std::endl;
+  out << "    result.data = load_variant(best);" << std::endl;
+  out << "    result.encoding = file_variants[best].encoding;" << std::endl;
+  out << "    result.etag = file_variants[best].etag;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  return result;" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_profile(std::ostream &out)
+{
+  out << "#ifdef BINFS_PROFILE" << std::endl;
+  out << "#ifndef BINFS_PROFILE_FILE" << std::endl;
+  out << "#define BINFS_PROFILE_FILE \"binfs.profile\"" << std::endl;
+  out << "#endif" << std::endl;
+  out << std::endl;
+  out << "// Access counters of the instrumented build. The state is a function-local" << std::endl;
+  out << "// static so every translation unit shares it, and its destructor writes the" << std::endl;
+  out << "// profile (\"rank hits path\" per accessed file, in first-access order) when" << std::endl;
+  out << "// the process exits. BINFS_PROFILE_FILE in the environment overrides the path." << std::endl;
+  out << "struct profile_state" << std::endl;
+  out << "{" << std::endl;
+  out << "  std::atomic<uint64_t> hits[file_count + 1];" << std::endl;
+  out << "  std::atomic<uint32_t> rank[file_count + 1];" << std::endl;
+  out << "  std::atomic<uint32_t> next;" << std::endl;
+  out << std::endl;
+  out << "  ~profile_state()" << std::endl;
+  out << "  {" << std::endl;
+  out << "    const char *path = std::getenv(\"BINFS_PROFILE_FILE\");" << std::endl;
+  out << "    FILE *f = std::fopen(path != nullptr ? path : BINFS_PROFILE_FILE, \"w\");" << std::endl;
+  out << "    if (f == nullptr)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      return;" << std::endl;
+  out << "    }" << std::endl;
+  out << "    std::vector<std::pair<uint32_t, size_t>> order;" << std::endl;
+  out << "    for (size_t i = 0; file_count > i; ++i)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      if (rank[i].load() != 0)" << std::endl;
+  out << "      {" << std::endl;
+  out << "        order.push_back(std::make_pair(rank[i].load(), i));" << std::endl;
+  out << "      }" << std::endl;
+  out << "    }" << std::endl;
+  out << "    std::sort(order.begin(), order.end());" << std::endl;
+  out << "    for (const std::pair<uint32_t, size_t> &entry : order)" << std::endl;
+  out << "    {" << std::endl;
+  out << "      std::fprintf(f, \"%u %llu %s\\n\", entry.first, static_cast<unsigned long long>(hits[entry.second].load()), path_name(path_table<>::index[path_table<>::files[entry.second]]).c_str());" << std::endl;
+  out << "    }" << std::endl;
+  out << "    std::fclose(f);" << std::endl;
+  out << "  }" << std::endl;
+  out << "};" << std::endl;
+  out << std::endl;
+  out << "inline profile_state &profile()" << std::endl;
+  out << "{" << std::endl;
+  out << "  static profile_state state;" << std::endl;
+  out << "  return state;" << std::endl;
+  out << "}" << std::endl;
+  out << "#endif" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_profile_definitions(std::ostream &out)
+{
+  out << "inline void BinFS::track(size_t i) const" << std::endl;
+  out << "{" << std::endl;
+  out << "  counters.accesses[i].fetch_add(1, std::memory_order_relaxed);" << std::endl;
+  out << "#ifdef BINFS_PROFILE" << std::endl;
+  out << "  profile_state &state = profile();" << std::endl;
+  out << "  if (state.hits[i].fetch_add(1, std::memory_order_relaxed) == 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    state.rank[i].store(state.next.fetch_add(1) + 1, std::memory_order_relaxed);" << std::endl;
+  out << "  }" << std::endl;
+  out << "#endif" << std::endl;
+  out << "}" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_dev_includes(std::ostream &out)
+{
+  out << "#ifdef BINFS_DEV_OVERLAY" << std::endl;
+  out << "#include <map>" << std::endl;
+  if (!is_absolute(dirpath))
+  {
+    // The directory binfs ran in is not written into the header, which would
+    // make it differ between checkouts.
+    out << "#ifndef BINFS_DEV_ROOT" << std::endl;
+    out << "#error \"BINFS_DEV_OVERLAY needs BINFS_DEV_ROOT, the directory binfs was run from\"" << std::endl;
+    out << "#endif" << std::endl;
+  }
+  out << "#endif" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_dev_declarations(std::ostream &out)
+{
+  out << "#ifdef BINFS_DEV_OVERLAY" << std::endl;
+  out << "  struct dev_file" << std::endl;
+  out << "  {" << std::endl;
+  out << "    std::string data;" << std::endl;
+  out << "    time_t mtime;" << std::endl;
+  out << "    off_t size;" << std::endl;
+  out << "  };" << std::endl;
+  out << "  mutable std::map<std::string, dev_file> dev_files;" << std::endl;
+  out << "  mutable std::mutex dev_mutex;" << std::endl;
+  out << "  bool dev_lookup(const std::string &filename, view &out) const;" << std::endl;
+  out << "#endif" << std::endl;
+}
+
+void BinFS::output_dev_definitions(std::ostream &out)
+{
+  out << "#ifdef BINFS_DEV_OVERLAY" << std::endl;
+  out << "// Reads filename from disk (under BINFS_DEV_ROOT and the -root binfs was given)" << std::endl;
+  out << "// instead of the embedded data. The copy is cached; with BINFS_DEV_RELOAD it is" << std::endl;
+  out << "// re-read whenever the file's mtime or size changes, which invalidates views" << std::endl;
+  out << "// handed out earlier for that file." << std::endl;
+  out << "inline bool BinFS::dev_lookup(const std::string &filename, view &out) const" << std::endl;
+  out << "{" << std::endl;
+  if (is_absolute(dirpath))
+  {
+    out << "  std::string path = \"" << octal_literal(dirpath + "/") << "\" + filename;" << std::endl;
+  }
+  else
+  {
+    out << "  std::string path = !filename.empty() && filename[0] == '/' ? filename : std::string(BINFS_DEV_ROOT) + \"/" << octal_literal(dirpath == "" ? "" : dirpath + "/") << "\" + filename;" << std::endl;
+  }
+  out << "  std::lock_guard<std::mutex> lock(dev_mutex);" << std::endl;
+  out << "  std::map<std::string, dev_file>::iterator it = dev_files.find(filename);" << std::endl;
+  out << "  struct stat s;" << std::endl;
+  out << "#ifdef BINFS_DEV_RELOAD" << std::endl;
+  out << "  if (stat(path.c_str(), &s) != 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return false;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  if (it != dev_files.end() && it->second.mtime == s.st_mtime && it->second.size == s.st_size)" << std::endl;
+  out << "#else" << std::endl;
+  out << "  if (it != dev_files.end())" << std::endl;
+  out << "#endif" << std::endl;
+  out << "  {" << std::endl;
+  out << "    out = view(it->second.data.data(), it->second.data.size());" << std::endl;
+  out << "    return true;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  std::ifstream file(path, std::ios::in | std::ios::binary);" << std::endl;
+  out << "  if (!file.is_open() || stat(path.c_str(), &s) != 0)" << std::endl;
+  out << "  {" << std::endl;
+  out << "    return false;" << std::endl;
+  out << "  }" << std::endl;
+  out << "  std::stringstream ss;" << std::endl;
+  out << "  ss << file.rdbuf();" << std::endl;
+  out << "  dev_file &entry = dev_files[filename];" << std::endl;
+  out << "  entry.data = ss.str();" << std::endl;
+  out << "  entry.mtime = s.st_mtime;" << std::endl;
+  out << "  entry.size = s.st_size;" << std::endl;
+  out << "  out = view(entry.data.data(), entry.data.size());" << std::endl;
+  out << "  return true;" << std::endl;
+  out << "}" << std::endl;
+  out << "#endif" << std::endl;
+  out << std::endl;
+}
+
+void BinFS::output_hpp(std::ostream &out, std::ostream *source, const std::string &header)
+{
+  output_unit(out, source, header, [this](std::ostream &declarations) { output_embedded_declarations(declarations); },
+              [this](std::ostream &definitions) { output_embedded_definitions(definitions); });
+}
+
+void BinFS::output_hpp(int fd)
+{
+  fd_buffer buffer(fd);
+  std::ostream out(&buffer);
+  output_hpp(out);
+  if (!out.flush())
+  {
+    throw std::runtime_error("cannot write the header!");
+  }
+}
+
+void BinFS::output_hpp_file(const std::string &filename)
+{
+  std::ofstream out;
+  std::ofstream source;
+  open_output(out, filename);
+  if (sourcefile != "")
+  {
+    open_output(source, sourcefile);
+  }
+  output_hpp(out, sourcefile == "" ? nullptr : &source, filename);
+}
+
+uint64_t BinFS::pack_layout(std::string &index, std::vector<const std::string *> &blobs, std::vector<uint64_t> &offsets)
+{
+  uint64_t index_size = 0;
+  for (const file_entry &file : files)
+  {
+    index_size += 20 + file.name.length();
+    blobs.push_back(&file.payload());
+    for (const file_variant &variant : file.variants)
+    {
+      index_size += 24 + variant.encoding.length();
+    }
+  }
+  for (const file_entry &file : files)
+  {
+    for (const file_variant &variant : file.variants)
+    {
+      blobs.push_back(&variant.data);
+    }
+  }
+
+  uint64_t offset = align_up(pack_header_size + index_size, pack_alignment);
+  for (const std::string *blob : blobs)
+  {
+    uint64_t length = blob->length();
+    if (length >= pack_alignment || offset / pack_alignment != (offset + length - (length > 0 ? 1 : 0)) / pack_alignment)
+    {
+      offset = align_up(offset, pack_alignment);
+    }
+    offsets.push_back(offset);
+    offset += length;
+  }
+
+  size_t blob = 0;
+  for (const file_entry &file : files)
+  {
+    put_u64(index, offsets[blob]);
+    put_u64(index, file.payload().length());
+    put_u32(index, static_cast<uint32_t>(file.name.length()));
+    index.append(file.name);
+    blob++;
+  }
+  for (size_t i = 0; files.size() > i; ++i)
+  {
+    for (const file_variant &variant : files[i].variants)
+    {
+      put_u64(index, offsets[blob]);
+      put_u64(index, variant.data.length());
+      put_u32(index, static_cast<uint32_t>(i));
+      put_u32(index, static_cast<uint32_t>(variant.encoding.length()));
+      index.append(variant.encoding);
+      blob++;
+    }
+  }
+
+  // FNV-1a over the index ties the generated header to the pack it was built with.
+  uint64_t id = 14695981039346656037ULL;
+  for (char c : index)
+  {
+    id = (id ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+  }
+
+  return id;
+}
+
+void BinFS::output_pack(std::ostream &pack, std::ostream &out, const std::string &packfile, std::ostream *source, const std::string &header)
+{
+  std::string index;
+  std::vector<const std::string *> blobs;
+  std::vector<uint64_t> offsets;
+  uint64_t id = pack_layout(index, blobs, offsets);
+  uint64_t data_offset = align_up(pack_header_size + index.length(), pack_alignment);
+  uint64_t total_size = blobs.empty() ? data_offset : offsets.back() + blobs.back()->length();
+
+  std::string pack_header(pack_magic, 8);
+  put_u32(pack_header, pack_version);
+  put_u32(pack_header, static_cast<uint32_t>(files.size()));
+  put_u64(pack_header, id);
+  put_u64(pack_header, pack_header_size);
+  put_u64(pack_header, data_offset);
+  put_u64(pack_header, total_size);
+  put_u32(pack_header, static_cast<uint32_t>(blobs.size() - files.size()));
+  put_u32(pack_header, 0);
+  put_u64(pack_header, 0);
+
+  // Pipes and sockets cannot seek, so the padding and zero pages are written
+  // out there instead of being left as holes.
+  std::streamoff base = pack.tellp();
+  pack << pack_header << index;
+  uint64_t written = pack_header_size + index.length();
+  for (size_t i = 0; blobs.size() > i; ++i)
+  {
+    if (base < 0)
+    {
+      pack << std::string(offsets[i] - written, '\0') << *blobs[i];
+    }
+    else
+    {
+      write_sparse(pack, base, offsets[i], *blobs[i]);
+    }
+    written = offsets[i] + blobs[i]->length();
+  }
+  if (base < 0)
+  {
+    pack << std::string(total_size - written, '\0');
+  }
+  else
+  {
+    pack.seekp(0, std::ios::end);
+    if (base + static_cast<std::streamoff>(total_size) > pack.tellp())
+    {
+      pack.seekp(base + static_cast<std::streamoff>(total_size) - 1);
+      pack.put('\0');
+    }
+  }
+  if (!pack.flush())
+  {
+    throw std::runtime_error("cannot write " + packfile);
+  }
+
+  output_unit(out, source, header, [&](std::ostream &declarations) { output_pack_declarations(declarations, packfile); },
+              [&](std::ostream &definitions) { output_pack_definitions(definitions, id, blobs, offsets); });
+}
+
+void BinFS::output_pack(int pack_fd, int fd, const std::string &packfile)
+{
+  fd_buffer pack_buffer(pack_fd);
+  fd_buffer buffer(fd);
+  std::ostream pack(&pack_buffer);
+  std::ostream out(&buffer);
+  output_pack(pack, out, packfile);
+  if (!out.flush())
+  {
+    throw std::runtime_error("cannot write the header!");
+  }
+}
+
+void BinFS::output_pack_file(const std::string &packfile, const std::string &hppfile)
+{
+  std::ofstream pack;
+  std::ofstream out;
+  std::ofstream source;
+  open_output(pack, packfile, std::ios::out | std::ios::binary | std::ios::trunc);
+  open_output(out, hppfile);
+  if (sourcefile != "")
+  {
+    open_output(source, sourcefile);
+  }
+  output_pack(pack, out, packfile, sourcefile == "" ? nullptr : &source, hppfile);
 }
 
 } // BinFS
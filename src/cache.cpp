@@ -0,0 +1,116 @@
+#include "cache.h"
+#include "hash.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace BinFS
+{
+
+// Every fragment starts with this magic and the xxh64 of its bytes, so a
+// truncated or damaged cache entry reads as a miss instead of bad output.
+static const char cache_magic[] = "BINFSCF1";
+static const size_t cache_header_size = 16;
+
+static void make_directory(const std::string &path)
+{
+#if defined(_WIN32)
+  int ret = _mkdir(path.c_str());
+#else
+  int ret = mkdir(path.c_str(), 0755);
+#endif
+  if (ret != 0 && errno != EEXIST)
+  {
+    throw std::runtime_error("cannot create " + path);
+  }
+}
+
+// Fragments are spread over 256 subdirectories by the first byte of the key
+// hash, which keeps directories small for large bundles.
+static std::string fragment_path(const std::string &directory, const std::string &key, bool create)
+{
+  std::string shard = strong_etag(xxh64(key.data(), key.length())).substr(1, 2);
+  if (create)
+  {
+    make_directory(directory);
+    make_directory(directory + "/" + shard);
+  }
+
+  return directory + "/" + shard + "/" + key;
+}
+
+static uint64_t read_u64(const char *p)
+{
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; --i)
+  {
+    v = v << 8 | static_cast<unsigned char>(p[i]);
+  }
+  return v;
+}
+
+bool cache_load(const std::string &directory, const std::string &key, std::string &fragment)
+{
+  std::ifstream in(fragment_path(directory, key, false), std::ios::in | std::ios::binary | std::ios::ate);
+  if (!in.is_open())
+  {
+    return false;
+  }
+  std::string data(static_cast<size_t>(in.tellg()), '\0');
+  in.seekg(0, std::ios::beg);
+  if (data.length() < cache_header_size || !in.read(&data[0], data.size()) || data.compare(0, 8, cache_magic) != 0)
+  {
+    return false;
+  }
+  if (read_u64(data.data() + 8) != xxh64(data.data() + cache_header_size, data.length() - cache_header_size))
+  {
+    return false;
+  }
+
+  fragment = data.substr(cache_header_size);
+  return true;
+}
+
+void cache_store(const std::string &directory, const std::string &key, const std::string &fragment)
+{
+  std::string path = fragment_path(directory, key, true);
+#if defined(_WIN32)
+  std::string temporary = path + "." + std::to_string(_getpid()) + ".tmp";
+#else
+  std::string temporary = path + "." + std::to_string(getpid()) + ".tmp";
+#endif
+  uint64_t hash = xxh64(fragment.data(), fragment.length());
+  std::string header(cache_magic, 8);
+  for (int i = 0; i < 8; ++i)
+  {
+    header.push_back(static_cast<char>((hash >> (i * 8)) & 0xff));
+  }
+
+  std::ofstream out(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+  out << header << fragment;
+  out.close();
+  if (!out)
+  {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("cannot write " + temporary);
+  }
+#if defined(_WIN32)
+  std::remove(path.c_str());
+#endif
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
+  {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("cannot write " + path);
+  }
+}
+
+} // BinFS
@@ -0,0 +1,250 @@
+#include "compress.h"
+#include "parallel.h"
+
+#include <stdexcept>
+#include <vector>
+#ifdef BINFS_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BINFS_HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace BinFS
+{
+
+bool encoding_supported(const std::string &encoding)
+{
+#ifdef BINFS_HAVE_ZLIB
+  if (encoding == "gzip")
+  {
+    return true;
+  }
+#endif
+#ifdef BINFS_HAVE_BROTLI
+  if (encoding == "br")
+  {
+    return true;
+  }
+#endif
+  return false;
+}
+
+bool is_compressible(const std::string &mime)
+{
+  static const char *types[] = {
+      "application/json", "application/manifest+json", "application/xml", "application/wasm",
+      "image/svg+xml", "image/bmp", "image/x-icon", "font/ttf", "font/otf"};
+
+  if (mime.compare(0, 5, "text/") == 0)
+  {
+    return true;
+  }
+  for (const char *type : types)
+  {
+    if (mime == type)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef BINFS_HAVE_ZLIB
+// Inputs above one slice are deflated slice by slice on the thread pool, the
+// way pigz does it: every slice is primed with the 32 KiB before it and ends
+// on a sync flush, so the pieces concatenate into one deflate stream. The
+// slicing does not depend on the number of jobs, so neither does the output.
+static const size_t gzip_slice = 1 << 20;
+static const size_t deflate_window = 32768;
+
+static std::string deflate_slice(const std::string &in, size_t begin, size_t end, bool last)
+{
+  z_stream zs = z_stream();
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    throw std::runtime_error("cannot initialize gzip encoder!");
+  }
+  size_t primed = begin < deflate_window ? begin : deflate_window;
+  if (primed > 0 && deflateSetDictionary(&zs, reinterpret_cast<const Bytef *>(in.data() + begin - primed), static_cast<uInt>(primed)) != Z_OK)
+  {
+    deflateEnd(&zs);
+    throw std::runtime_error("cannot initialize gzip encoder!");
+  }
+
+  // deflateBound covers Z_FINISH; the margin leaves room for the empty
+  // stored block a sync flush appends.
+  std::string out(deflateBound(&zs, end - begin) + 16, '\0');
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data() + begin));
+  zs.avail_in = static_cast<uInt>(end - begin);
+  zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  zs.avail_out = static_cast<uInt>(out.length());
+  int ret = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+  bool complete = last ? ret == Z_STREAM_END : ret == Z_OK && zs.avail_in == 0 && zs.avail_out != 0;
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  if (!complete)
+  {
+    throw std::runtime_error("gzip encoding failed!");
+  }
+
+  return out;
+}
+
+static void put_u32(std::string &out, uLong value)
+{
+  for (int i = 0; i < 4; ++i)
+  {
+    out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+static std::string gzip_compress_parallel(const std::string &in)
+{
+  size_t count = (in.length() + gzip_slice - 1) / gzip_slice;
+  std::vector<std::string> parts(count);
+  std::vector<uLong> crcs(count);
+  parallel_for(count, [&](size_t i) {
+    size_t begin = i * gzip_slice;
+    size_t end = in.length() < begin + gzip_slice ? in.length() : begin + gzip_slice;
+    parts[i] = deflate_slice(in, begin, end, i + 1 == count);
+    crcs[i] = crc32(0L, reinterpret_cast<const Bytef *>(in.data() + begin), static_cast<uInt>(end - begin));
+  });
+
+  uLong crc = crcs[0];
+  for (size_t i = 1; count > i; ++i)
+  {
+    size_t begin = i * gzip_slice;
+    size_t length = in.length() < begin + gzip_slice ? in.length() - begin : gzip_slice;
+    crc = crc32_combine(crc, crcs[i], static_cast<z_off_t>(length));
+  }
+
+  // Same header zlib writes at level 9: no name, no mtime, XFL 2, OS unix.
+  std::string out("\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\x03", 10);
+  for (std::string &part : parts)
+  {
+    out += part;
+    std::string().swap(part);
+  }
+  put_u32(out, crc);
+  put_u32(out, static_cast<uLong>(in.length() & 0xffffffffUL));
+
+  return out;
+}
+
+static std::string gzip_compress(const std::string &in)
+{
+  if (in.length() > gzip_slice)
+  {
+    return gzip_compress_parallel(in);
+  }
+
+  z_stream zs = z_stream();
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    throw std::runtime_error("cannot initialize gzip encoder!");
+  }
+
+  std::string out(deflateBound(&zs, in.length()), '\0');
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+  zs.avail_in = static_cast<uInt>(in.length());
+  zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  zs.avail_out = static_cast<uInt>(out.length());
+  int ret = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  if (ret != Z_STREAM_END)
+  {
+    throw std::runtime_error("gzip encoding failed!");
+  }
+
+  return out;
+}
+#endif
+
+#ifdef BINFS_HAVE_BROTLI
+static std::string brotli_compress(const std::string &in)
+{
+  size_t size = BrotliEncoderMaxCompressedSize(in.length());
+  std::string out(size ? size : in.length() + 1024, '\0');
+  size = out.length();
+  if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC, in.length(),
+                             reinterpret_cast<const uint8_t *>(in.data()), &size, reinterpret_cast<uint8_t *>(&out[0])))
+  {
+    throw std::runtime_error("brotli encoding failed!");
+  }
+  out.resize(size);
+
+  return out;
+}
+#endif
+
+std::string compress(const std::string &encoding, const std::string &in)
+{
+#ifdef BINFS_HAVE_ZLIB
+  if (encoding == "gzip")
+  {
+    return gzip_compress(in);
+  }
+#endif
+#ifdef BINFS_HAVE_BROTLI
+  if (encoding == "br")
+  {
+    return brotli_compress(in);
+  }
+#endif
+  throw std::runtime_error(encoding + " encoding is not supported by this build!");
+}
+
+std::string encoder_settings(const std::string &encoding)
+{
+#ifdef BINFS_HAVE_ZLIB
+  if (encoding == "gzip" || encoding == "dict")
+  {
+    return encoding + "-9-slice" + std::to_string(gzip_slice) + "-zlib" + zlibVersion();
+  }
+#endif
+#ifdef BINFS_HAVE_BROTLI
+  if (encoding == "br")
+  {
+    uint32_t version = BrotliEncoderVersion();
+    return "br-11-brotli" + std::to_string(version >> 24) + "." + std::to_string((version >> 12) & 0xfff) + "." + std::to_string(version & 0xfff);
+  }
+#endif
+  return encoding;
+}
+
+// Raw deflate primed with a preset dictionary; the generated runtime inflates
+// it with the same dictionary embedded once for the whole bundle.
+std::string deflate_with_dictionary(const std::string &in, const std::string &dictionary)
+{
+#ifdef BINFS_HAVE_ZLIB
+  z_stream zs = z_stream();
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK ||
+      deflateSetDictionary(&zs, reinterpret_cast<const Bytef *>(dictionary.data()), static_cast<uInt>(dictionary.length())) != Z_OK)
+  {
+    throw std::runtime_error("cannot initialize deflate encoder!");
+  }
+
+  std::string out(deflateBound(&zs, in.length()), '\0');
+  zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+  zs.avail_in = static_cast<uInt>(in.length());
+  zs.next_out = reinterpret_cast<Bytef *>(&out[0]);
+  zs.avail_out = static_cast<uInt>(out.length());
+  int ret = deflate(&zs, Z_FINISH);
+  out.resize(zs.total_out);
+  deflateEnd(&zs);
+  if (ret != Z_STREAM_END)
+  {
+    throw std::runtime_error("deflate encoding failed!");
+  }
+
+  return out;
+#else
+  (void)in;
+  (void)dictionary;
+  throw std::runtime_error("shared dictionary compression needs zlib!");
+#endif
+}
+
+} // BinFS
@@ -0,0 +1,132 @@
+#include "dictionary.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace BinFS
+{
+
+static const size_t kmer_size = 8;
+static const size_t segment_size = 64;
+static const size_t max_sample_bytes = 16 * 1024 * 1024;
+
+static uint64_t kmer_at(const std::string &data, size_t pos)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (size_t i = 0; kmer_size > i; ++i)
+  {
+    h = (h ^ static_cast<unsigned char>(data[pos + i])) * 1099511628211ULL;
+  }
+  return h;
+}
+
+struct segment
+{
+  const std::string *sample;
+  size_t pos;
+  uint64_t score;
+};
+
+// A simplified COVER trainer: k-mers are weighted by the number of samples
+// they occur in, the samples are split into one epoch per dictionary segment,
+// and each epoch contributes its best scoring window. K-mers of a chosen
+// window stop counting so later epochs pick different content. The best
+// segments go last since zlib reaches the end of a preset dictionary with the
+// shortest distances.
+std::string train_dictionary(const std::vector<const std::string *> &samples, size_t max_size)
+{
+  std::vector<const std::string *> used;
+  size_t total = 0;
+  size_t step = 1;
+  for (const std::string *sample : samples)
+  {
+    total += sample->length();
+  }
+  if (total > max_sample_bytes)
+  {
+    step = (total + max_sample_bytes - 1) / max_sample_bytes;
+  }
+  for (size_t i = 0; samples.size() > i; i += step)
+  {
+    if (samples[i]->length() >= segment_size)
+    {
+      used.push_back(samples[i]);
+    }
+  }
+
+  std::unordered_map<uint64_t, uint32_t> frequency;
+  for (const std::string *sample : used)
+  {
+    std::unordered_set<uint64_t> seen;
+    for (size_t pos = 0; pos + kmer_size <= sample->length(); ++pos)
+    {
+      seen.insert(kmer_at(*sample, pos));
+    }
+    for (uint64_t kmer : seen)
+    {
+      frequency[kmer]++;
+    }
+  }
+
+  size_t epochs = std::max<size_t>(1, std::min(used.size(), max_size / segment_size));
+  std::vector<segment> chosen;
+  for (size_t epoch = 0; epochs > epoch; ++epoch)
+  {
+    segment best = {nullptr, 0, 0};
+    size_t begin = used.size() * epoch / epochs;
+    size_t end = used.size() * (epoch + 1) / epochs;
+    for (size_t s = begin; end > s; ++s)
+    {
+      const std::string &sample = *used[s];
+      std::vector<uint64_t> kmers;
+      for (size_t pos = 0; pos + kmer_size <= sample.length(); ++pos)
+      {
+        kmers.push_back(kmer_at(sample, pos));
+      }
+
+      // Sliding sum over the k-mers that start inside a window; k-mers seen
+      // in a single sample are useless for a shared dictionary.
+      size_t window = segment_size - kmer_size + 1;
+      uint64_t score = 0;
+      for (size_t pos = 0; kmers.size() > pos; ++pos)
+      {
+        uint32_t f = frequency[kmers[pos]];
+        score += f > 1 ? f : 0;
+        if (pos >= window)
+        {
+          uint32_t old = frequency[kmers[pos - window]];
+          score -= old > 1 ? old : 0;
+        }
+        if (pos + 1 >= window && score > best.score)
+        {
+          best.sample = &sample;
+          best.pos = pos + 1 - window;
+          best.score = score;
+        }
+      }
+    }
+    if (best.sample == nullptr)
+    {
+      continue;
+    }
+    for (size_t pos = best.pos; pos + kmer_size <= best.pos + segment_size; ++pos)
+    {
+      frequency[kmer_at(*best.sample, pos)] = 0;
+    }
+    chosen.push_back(best);
+  }
+
+  std::stable_sort(chosen.begin(), chosen.end(), [](const segment &a, const segment &b) { return a.score > b.score; });
+  chosen.resize(std::min(chosen.size(), max_size / segment_size));
+  std::string dictionary;
+  for (size_t i = chosen.size(); i > 0; --i)
+  {
+    dictionary.append(*chosen[i - 1].sample, chosen[i - 1].pos, segment_size);
+  }
+
+  return dictionary;
+}
+
+} // BinFS
@@ -0,0 +1,105 @@
+#include "fdstream.h"
+
+#include <algorithm>
+#include <cerrno>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace BinFS
+{
+
+static const size_t fd_buffer_size = 64 * 1024;
+
+fd_buffer::fd_buffer(int fd_) : fd(fd_), buffer(fd_buffer_size)
+{
+  setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+fd_buffer::~fd_buffer()
+{
+  flush_buffer();
+}
+
+bool fd_buffer::flush_buffer()
+{
+  const char *p = pbase();
+  while (pptr() > p)
+  {
+#if defined(_WIN32)
+    int written = _write(fd, p, static_cast<unsigned>(pptr() - p));
+#else
+    ssize_t written = write(fd, p, static_cast<size_t>(pptr() - p));
+#endif
+    if (written < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (written <= 0)
+    {
+      return false;
+    }
+    p += written;
+  }
+  setp(buffer.data(), buffer.data() + buffer.size());
+  return true;
+}
+
+fd_buffer::int_type fd_buffer::overflow(int_type c)
+{
+  if (!flush_buffer())
+  {
+    return traits_type::eof();
+  }
+  if (!traits_type::eq_int_type(c, traits_type::eof()))
+  {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+std::streamsize fd_buffer::xsputn(const char *s, std::streamsize n)
+{
+  std::streamsize done = 0;
+  while (n > done)
+  {
+    if (pptr() == epptr() && !flush_buffer())
+    {
+      break;
+    }
+    std::streamsize chunk = std::min<std::streamsize>(n - done, epptr() - pptr());
+    traits_type::copy(pptr(), s + done, static_cast<size_t>(chunk));
+    pbump(static_cast<int>(chunk));
+    done += chunk;
+  }
+  return done;
+}
+
+int fd_buffer::sync()
+{
+  return flush_buffer() ? 0 : -1;
+}
+
+fd_buffer::pos_type fd_buffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+  if (!(which & std::ios_base::out) || !flush_buffer())
+  {
+    return pos_type(off_type(-1));
+  }
+  int whence = dir == std::ios_base::beg ? SEEK_SET : dir == std::ios_base::cur ? SEEK_CUR : SEEK_END;
+#if defined(_WIN32)
+  return pos_type(off_type(_lseeki64(fd, off, whence)));
+#else
+  return pos_type(off_type(lseek(fd, off, whence)));
+#endif
+}
+
+fd_buffer::pos_type fd_buffer::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+} // BinFS
@@ -0,0 +1,179 @@
+#include "hash.h"
+
+#include <cstring>
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define BINFS_HW_CRC32C 1
+#endif
+
+namespace BinFS
+{
+
+static const uint64_t prime1 = 11400714785074694791ULL;
+static const uint64_t prime2 = 14029467366897019727ULL;
+static const uint64_t prime3 = 1609587929392839161ULL;
+static const uint64_t prime4 = 9650029242287828579ULL;
+static const uint64_t prime5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl(uint64_t v, int r)
+{
+  return (v << r) | (v >> (64 - r));
+}
+
+static inline uint64_t load64(const char *p)
+{
+  uint64_t v = 0;
+  for (int i = 7; i >= 0; --i)
+  {
+    v = (v << 8) | static_cast<unsigned char>(p[i]);
+  }
+  return v;
+}
+
+static inline uint32_t load32(const char *p)
+{
+  return static_cast<uint32_t>(load64(p) & 0xffffffff);
+}
+
+static inline uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+  acc += input * prime2;
+  acc = rotl(acc, 31);
+  return acc * prime1;
+}
+
+static inline uint64_t xxh64_merge(uint64_t acc, uint64_t val)
+{
+  acc ^= xxh64_round(0, val);
+  return acc * prime1 + prime4;
+}
+
+uint64_t xxh64(const char *data, size_t len, uint64_t seed)
+{
+  const char *p = data;
+  const char *end = data + len;
+  uint64_t h;
+
+  if (len >= 32)
+  {
+    uint64_t v1 = seed + prime1 + prime2;
+    uint64_t v2 = seed + prime2;
+    uint64_t v3 = seed;
+    uint64_t v4 = seed - prime1;
+    do
+    {
+      v1 = xxh64_round(v1, load64(p));
+      v2 = xxh64_round(v2, load64(p + 8));
+      v3 = xxh64_round(v3, load64(p + 16));
+      v4 = xxh64_round(v4, load64(p + 24));
+      p += 32;
+    } while (end - p >= 32);
+
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = xxh64_merge(h, v1);
+    h = xxh64_merge(h, v2);
+    h = xxh64_merge(h, v3);
+    h = xxh64_merge(h, v4);
+  }
+  else
+  {
+    h = seed + prime5;
+  }
+
+  h += static_cast<uint64_t>(len);
+  for (; end - p >= 8; p += 8)
+  {
+    h ^= xxh64_round(0, load64(p));
+    h = rotl(h, 27) * prime1 + prime4;
+  }
+  if (end - p >= 4)
+  {
+    h ^= static_cast<uint64_t>(load32(p)) * prime1;
+    h = rotl(h, 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; ++p)
+  {
+    h ^= static_cast<unsigned char>(*p) * prime5;
+    h = rotl(h, 11) * prime1;
+  }
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
+
+static uint32_t crc32c_software(const char *data, size_t len, uint32_t crc)
+{
+  static uint32_t table[256];
+  static bool ready = false;
+  if (!ready)
+  {
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k)
+      {
+        c = (c & 1) ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+      }
+      table[i] = c;
+    }
+    ready = true;
+  }
+
+  for (size_t i = 0; i < len; ++i)
+  {
+    crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef BINFS_HW_CRC32C
+__attribute__((target("sse4.2"))) static uint32_t crc32c_hardware(const char *data, size_t len, uint32_t crc)
+{
+#if defined(__x86_64__)
+  uint64_t c = crc;
+  for (; len >= 8; data += 8, len -= 8)
+  {
+    uint64_t v;
+    std::memcpy(&v, data, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  crc = static_cast<uint32_t>(c);
+#endif
+  for (; len > 0; ++data, --len)
+  {
+    crc = _mm_crc32_u8(crc, static_cast<unsigned char>(*data));
+  }
+  return crc;
+}
+#endif
+
+uint32_t crc32c(const char *data, size_t len, uint32_t crc)
+{
+  crc = ~crc;
+#ifdef BINFS_HW_CRC32C
+  if (__builtin_cpu_supports("sse4.2"))
+  {
+    return ~crc32c_hardware(data, len, crc);
+  }
+#endif
+  return ~crc32c_software(data, len, crc);
+}
+
+std::string strong_etag(uint64_t hash)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string etag("\"");
+  for (int i = 60; i >= 0; i -= 4)
+  {
+    etag.push_back(digits[(hash >> i) & 0xf]);
+  }
+  etag.push_back('"');
+  return etag;
+}
+
+} // BinFS
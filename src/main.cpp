@@ -4,28 +4,118 @@
 
 #include <string>
 #include <vector>
+#include <set>
+#include <map>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <algorithm>
+#include <stdexcept>
 #include <cstring>
 #include <sys/stat.h>
 #if !defined(WINDOWS)
 #include <dirent.h>
-#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+#if defined(WINDOWS)
 #include <3rdparty/win32/dirent.h>
+#include <direct.h>
 #endif
 #include "binfs.h"
+#include "parallel.h"
+
+// Identity of a file or directory; hardlinks and symlinks to the same
+// object share it. Windows has no usable inode numbers, so there every path
+// is treated as distinct.
+typedef std::pair<dev_t, ino_t> file_id;
+
+// What a scan remembers about a file to notice that it changed.
+struct file_stamp
+{
+  off_t size;
+  ino_t ino;
+  int64_t mtime;
+  int64_t ctime;
+
+  bool operator==(const file_stamp &other) const
+  {
+    return size == other.size && ino == other.ino && mtime == other.mtime && ctime == other.ctime;
+  }
+};
 
-std::vector<std::string> get_files(const std::string &path, std::vector<std::string> &paths)
+file_stamp stamp_of(const struct stat &s)
+{
+  file_stamp stamp;
+  stamp.size = s.st_size;
+  stamp.ino = s.st_ino;
+#if defined(__linux__)
+  stamp.mtime = int64_t(s.st_mtim.tv_sec) * 1000000000 + s.st_mtim.tv_nsec;
+  stamp.ctime = int64_t(s.st_ctim.tv_sec) * 1000000000 + s.st_ctim.tv_nsec;
+#else
+  stamp.mtime = int64_t(s.st_mtime);
+  stamp.ctime = int64_t(s.st_ctime);
+#endif
+  return stamp;
+}
+
+struct walk_state
+{
+  // Directories on the current recursion path, to detect cycles.
+  std::set<file_id> ancestors;
+  // First path seen for every ingested file.
+  std::map<file_id, std::string> files;
+  // Later paths of an already seen file, mapped to that first path.
+  std::vector<std::pair<std::string, std::string>> aliases;
+  // Every directory that was listed.
+  std::vector<std::string> dirs;
+  // Ingested files in scan order.
+  std::vector<std::string> paths;
+  // Stamp of every ingested file, by path.
+  std::map<std::string, file_stamp> stamps;
+};
+
+void get_files(const std::string &path, walk_state &state)
 {
   struct stat s;
   if (stat(path.c_str(), &s) == 0)
   {
+    file_id id(s.st_dev, s.st_ino);
+#if defined(WINDOWS)
+    bool tracked = false;
+#else
+    bool tracked = true;
+#endif
     if (s.st_mode & S_IFREG)
     {
-      paths.push_back(path);
+      if (tracked)
+      {
+        std::map<file_id, std::string>::const_iterator seen = state.files.find(id);
+        if (seen != state.files.end())
+        {
+          state.aliases.push_back(std::make_pair(path, seen->second));
+          return;
+        }
+        state.files[id] = path;
+      }
+      state.stamps[path] = stamp_of(s);
+      state.paths.push_back(path);
     }
     else if (s.st_mode & S_IFDIR)
     {
+      if (tracked && !state.ancestors.insert(id).second)
+      {
+        fprintf(stderr, "skipping %s: directory cycle\n", path.c_str());
+        return;
+      }
+      state.dirs.push_back(path);
       DIR *dir;
       struct dirent *ent;
+      std::vector<std::string> entries;
       if ((dir = opendir(path.c_str())) != NULL)
       {
         while ((ent = readdir(dir)) != NULL)
@@ -33,32 +123,189 @@ std::vector<std::string> get_files(const std::string &path, std::vector<std::str
           std::string found(ent->d_name, strlen(ent->d_name));
           if (found != "." && found != "..")
           {
-            found = path + "/" + found;
-            get_files(found, paths);
+            entries.push_back(found);
           }
         }
         closedir(dir);
       }
+      // readdir order depends on the filesystem; sorting keeps the output
+      // identical across machines.
+      std::sort(entries.begin(), entries.end());
+      for (const std::string &entry : entries)
+      {
+        get_files(path == "." ? entry : path + "/" + entry, state);
+      }
+      if (tracked)
+      {
+        state.ancestors.erase(id);
+      }
+    }
+  }
+}
+
+// Collapses repeated separators and "." components and resolves ".." against
+// the preceding component where possible, without touching the filesystem.
+std::string normalize_path(std::string path)
+{
+#if defined(WINDOWS)
+  std::replace(path.begin(), path.end(), '\\', '/');
+#endif
+  bool absolute = !path.empty() && path[0] == '/';
+  std::vector<std::string> parts;
+  size_t pos = 0;
+  while (path.length() >= pos)
+  {
+    size_t end = path.find('/', pos);
+    end = end == std::string::npos ? path.length() : end;
+    std::string part = path.substr(pos, end - pos);
+    if (part == ".." && !parts.empty() && parts.back() != "..")
+    {
+      parts.pop_back();
+    }
+    else if (part == ".." && !absolute)
+    {
+      parts.push_back(part);
+    }
+    else if (part != "" && part != "." && part != "..")
+    {
+      parts.push_back(part);
     }
+    pos = end + 1;
+  }
+
+  std::string normalized(absolute ? "/" : "");
+  for (const std::string &part : parts)
+  {
+    normalized += (normalized == "" || normalized == "/" ? "" : "/") + part;
+  }
+
+  return normalized == "" ? "." : normalized;
+}
+
+// Name under which path is embedded: relative to root when one is given.
+std::string relative_to_root(const std::string &path, const std::string &root)
+{
+  if (root == "")
+  {
+    return path;
+  }
+  std::string prefix(root == "/" ? root : root + "/");
+  if (path.compare(0, prefix.length(), prefix) != 0)
+  {
+    throw std::runtime_error(path + " is outside of root " + root);
   }
 
-  return paths;
+  return path.substr(prefix.length());
 }
 
-std::string parse_output_file(int argc, char *argv[])
+std::string absolute_path(const std::string &path)
 {
-  std::string output_file("binfs.hpp");
+  if (!path.empty() && (path[0] == '/' || (path.length() > 1 && path[1] == ':')))
+  {
+    return normalize_path(path);
+  }
+  char cwd[4096];
+#if defined(WINDOWS)
+  if (_getcwd(cwd, sizeof(cwd)) == NULL)
+#else
+  if (getcwd(cwd, sizeof(cwd)) == NULL)
+#endif
+  {
+    throw std::runtime_error("cannot determine the current directory!");
+  }
+
+  return normalize_path(std::string(cwd) + "/" + path);
+}
+
+// Spaces, '#' and '$' need escaping in Make/Ninja depfiles.
+std::string depfile_escape(const std::string &path)
+{
+  std::string escaped;
+  for (char c : path)
+  {
+    if (c == ' ' || c == '#')
+    {
+      escaped.push_back('\\');
+    }
+    else if (c == '$')
+    {
+      escaped.push_back('$');
+    }
+    escaped.push_back(c);
+  }
+
+  return escaped;
+}
+
+// Writes "target: inputs..." with absolute paths, so the depfile stays valid
+// whatever directory the build tool runs from.
+void write_depfile(std::ostream &out, const std::string &target, const std::vector<std::string> &inputs)
+{
+  out << depfile_escape(absolute_path(target)) << ":";
+  for (const std::string &input : inputs)
+  {
+    out << " \\" << std::endl
+        << "  " << depfile_escape(absolute_path(input));
+  }
+  out << std::endl;
+}
+
+// Options that take a value; their values are not treated as input paths.
+const std::vector<std::string> value_options = {"-outfile", "-pack", "-pack-name", "-profile", "-dict-max-size", "-constexpr-max", "-source", "-root", "-depfile", "-jobs", "-cache", "-module", "-minify-exclude"};
+// Options that are switches without a value.
+const std::vector<std::string> flag_options = {"-gzip", "-brotli", "-dict", "-watch", "-minify", "-constexpr-index"};
+
+bool is_option(const std::vector<std::string> &options, const std::string &arg)
+{
+  for (const std::string &option : options)
+  {
+    if (arg == option)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::string parse_option(int argc, char *argv[], const std::string &name, const std::string &fallback)
+{
+  std::string value(fallback);
   for (int i = 1; i < argc; i++)
   {
     std::string arg(argv[i], strlen(argv[i]));
-    if (arg == "-outfile" && (argc > i + 1))
+    if (arg == name && (argc > i + 1))
     {
-      output_file = argv[i + 1];
+      value = argv[i + 1];
       continue;
     }
   }
 
-  return output_file;
+  return value;
+}
+
+size_t parse_size_option(int argc, char *argv[], const std::string &name, const std::string &fallback)
+{
+  std::string value = parse_option(argc, argv, name, fallback);
+  if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos)
+  {
+    throw std::runtime_error(name + " expects a non-negative number, got \"" + value + "\"!");
+  }
+
+  return std::stoul(value);
+}
+
+bool parse_flag(int argc, char *argv[], const std::string &name)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (name == argv[i])
+    {
+      return true;
+    }
+  }
+
+  return false;
 }
 
 std::vector<std::string> parse_folders(int argc, char *argv[])
@@ -68,7 +315,7 @@ std::vector<std::string> parse_folders(int argc, char *argv[])
   {
     std::string curr_arg(argv[i], strlen(argv[i]));
     std::string prev_arg(argv[i - 1], strlen(argv[i - 1]));
-    if (curr_arg != "-outfile" && prev_arg != "-outfile")
+    if (!is_option(value_options, curr_arg) && !is_option(flag_options, curr_arg) && !is_option(value_options, prev_arg))
     {
       files.push_back(argv[i]);
     }
@@ -77,36 +324,454 @@ std::vector<std::string> parse_folders(int argc, char *argv[])
   return files;
 }
 
+std::vector<std::string> split_list(const std::string &list)
+{
+  std::vector<std::string> items;
+  std::istringstream in(list);
+  std::string item;
+  while (std::getline(in, item, ','))
+  {
+    if (item != "")
+    {
+      items.push_back(normalize_path(item) + (item.back() == '/' ? "/" : ""));
+    }
+  }
+
+  return items;
+}
+
+void print_minify_report(const std::vector<BinFS::minify_result> &report)
+{
+  uint64_t before = 0, after = 0;
+  for (const BinFS::minify_result &file : report)
+  {
+    printf("minified %s: %llu -> %llu bytes (-%.1f%%)\n", file.name.c_str(), static_cast<unsigned long long>(file.before),
+           static_cast<unsigned long long>(file.after), 100.0 * (file.before - file.after) / file.before);
+    before += file.before;
+    after += file.after;
+  }
+  printf("minified %zu files, saved %llu bytes\n", report.size(), static_cast<unsigned long long>(before - after));
+}
+
 void usage(const char *progname)
 {
-  printf("Usage examples: \n  %s data/\n  %s -outfile include/binfs.hpp data/ /full/path/to/file.mp4\n\n", progname, progname);
+  printf("Usage examples: \n  %s data/\n  %s -outfile include/binfs.hpp data/ /full/path/to/file.mp4\n  %s -pack assets.pack -outfile include/binfs.hpp data/\n  %s -pack build/assets.pack -pack-name /usr/share/app/assets.pack data/\n  %s -gzip -brotli data/\n  %s -profile binfs.profile data/\n  %s -dict -dict-max-size 4096 i18n/\n  %s -constexpr-max 4096 config/\n  %s -outfile include/binfs.hpp -source src/binfs.cpp data/\n  %s -constexpr-index -outfile include/binfs.hpp -source src/binfs.cpp data/\n  %s -root assets assets/images assets/css\n  %s -outfile binfs.hpp -depfile binfs.hpp.d data/\n  %s -jobs 8 -gzip data/\n  %s -watch -outfile include/binfs.hpp -source src/binfs.cpp data/\n  %s -cache .binfs-cache -gzip -brotli data/\n  %s -module binfs.assets -outfile assets.cppm -source assets.cpp data/\n  %s -minify -minify-exclude data/vendor/,data/raw.json data/\n\n", progname, progname, progname, progname, progname, progname, progname, progname, progname, progname, progname, progname, progname, progname, progname, progname, progname);
   exit(1);
 }
 
-int main(int argc, char *argv[])
+void commit_file(const std::string &temporary, const std::string &path)
 {
-  if (argc < 2)
+#if defined(WINDOWS)
+  std::remove(path.c_str());
+#endif
+  if (std::rename(temporary.c_str(), path.c_str()) != 0)
   {
-    usage(argv[0]);
+    throw std::runtime_error("cannot rename " + temporary + " to " + path);
+  }
+}
+
+// Opens path.tmp for an output that commit_output later moves into place.
+void open_output(std::ofstream &out, const std::string &path)
+{
+  std::string temporary(path + ".tmp");
+  out.open(temporary, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out.is_open())
+  {
+    throw std::runtime_error("cannot write " + temporary);
   }
+}
 
-  BinFS::BinFS *binfs = new BinFS::BinFS();
+// Compares two files chunk by chunk, so large outputs are never held in
+// memory. A missing file compares unequal.
+bool same_contents(const std::string &first, const std::string &second)
+{
+  std::ifstream a(first, std::ios::in | std::ios::binary);
+  std::ifstream b(second, std::ios::in | std::ios::binary);
+  if (!a.is_open() || !b.is_open())
+  {
+    return false;
+  }
 
-  std::vector<std::string> folders = parse_folders(argc, argv);
-  std::string outfile = parse_output_file(argc, argv);
-  std::vector<std::string> files;
+  std::vector<char> chunk_a(64 * 1024);
+  std::vector<char> chunk_b(chunk_a.size());
+  while (true)
+  {
+    a.read(chunk_a.data(), chunk_a.size());
+    b.read(chunk_b.data(), chunk_b.size());
+    std::streamsize size = a.gcount();
+    if (size != b.gcount() || memcmp(chunk_a.data(), chunk_b.data(), size) != 0)
+    {
+      return false;
+    }
+    if (size < static_cast<std::streamsize>(chunk_a.size()))
+    {
+      return true;
+    }
+  }
+}
+
+// Closes an output opened with open_output and renames it over path, so
+// compilers and servers never see a half-written file. With skip_unchanged
+// an identical file is left alone, keeping its timestamp.
+bool commit_output(std::ofstream &out, const std::string &path, bool skip_unchanged)
+{
+  std::string temporary(path + ".tmp");
+  out.close();
+  if (!out)
+  {
+    std::remove(temporary.c_str());
+    throw std::runtime_error("cannot write " + temporary);
+  }
+  if (skip_unchanged && same_contents(temporary, path))
+  {
+    std::remove(temporary.c_str());
+    return false;
+  }
+  commit_file(temporary, path);
+  return true;
+}
+
+// Settings that stay fixed for every generation in a -watch session.
+struct generation
+{
+  std::vector<std::string> folders;
+  std::string root;
+  std::string outfile;
+  std::string sourcefile;
+  std::string packfile;
+  // Path the generated runtime opens by default; the -pack path unless set.
+  std::string packname;
+  std::string profile;
+  std::string depfile;
+  bool dict;
+  size_t dict_max_size;
+};
+
+walk_state scan_inputs(const generation &g)
+{
+  walk_state state;
+  for (const std::string &path : g.folders)
+  {
+    std::string input = normalize_path(path);
+    struct stat s;
+    if (stat(input.c_str(), &s) != 0)
+    {
+      throw std::runtime_error(input + " does not exists!");
+    }
+    get_files(input, state);
+  }
+
+  return state;
+}
+
+// Ingested files under the names they are embedded as.
+std::vector<std::string> embedded_names(const generation &g, const std::vector<std::string> &paths)
+{
+  std::vector<std::string> names;
+  for (const std::string &path : paths)
+  {
+    names.push_back(relative_to_root(path, g.root));
+  }
+
+  return names;
+}
+
+// Applies the whole-corpus steps and writes every output. Returns the number
+// of outputs that were rewritten.
+size_t write_outputs(BinFS::BinFS &binfs, const generation &g, const walk_state &state, bool skip_unchanged)
+{
+  if (g.profile != "")
+  {
+    binfs.apply_profile(g.profile);
+  }
+  if (g.dict)
+  {
+    binfs.use_shared_dictionary(g.dict_max_size);
+  }
+
+  // Outputs are streamed straight into their temporary files; a multi
+  // megabyte header is never buffered whole.
+  std::ofstream header;
+  std::ofstream source;
+  open_output(header, g.outfile);
+  if (g.sourcefile != "")
+  {
+    open_output(source, g.sourcefile);
+  }
+  std::ostream *split = g.sourcefile == "" ? nullptr : &source;
+
+  size_t written = 0;
+  try
+  {
+    if (g.packfile != "")
+    {
+      std::ofstream pack;
+      open_output(pack, g.packfile);
+      binfs.output_pack(pack, header, g.packname, split, g.outfile);
+      written += commit_output(pack, g.packfile, false) ? 1 : 0;
+    }
+    else
+    {
+      binfs.output_hpp(header, split, g.outfile);
+    }
+  }
+  catch (...)
+  {
+    // A failed generation leaves the previous outputs and no temporaries.
+    header.close();
+    source.close();
+    for (const std::string &path : {g.outfile, g.sourcefile, g.packfile})
+    {
+      if (path != "")
+      {
+        std::remove((path + ".tmp").c_str());
+      }
+    }
+    throw;
+  }
 
-  for (const std::string &path : folders)
+  written += commit_output(header, g.outfile, skip_unchanged) ? 1 : 0;
+  if (split != nullptr)
   {
-    files = get_files(path, files);
+    written += commit_output(source, g.sourcefile, skip_unchanged) ? 1 : 0;
   }
 
-  for (const std::string &path : files)
+  if (g.depfile != "")
   {
-    binfs->add_file(path);
+    std::vector<std::string> inputs(state.paths);
+    for (const std::pair<std::string, std::string> &alias : state.aliases)
+    {
+      inputs.push_back(alias.first);
+    }
+    inputs.insert(inputs.end(), state.dirs.begin(), state.dirs.end());
+    if (g.profile != "")
+    {
+      inputs.push_back(g.profile);
+    }
+    std::ofstream depfile;
+    open_output(depfile, g.depfile);
+    write_depfile(depfile, g.outfile, inputs);
+    commit_output(depfile, g.depfile, skip_unchanged);
   }
 
-  binfs->output_hpp_file(outfile);
+  return written;
+}
+
+#if defined(__linux__)
+
+std::string parent_directory(const std::string &path)
+{
+  size_t slash = path.find_last_of('/');
+  return slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// Watches every scanned directory, plus the directories holding file inputs
+// and the profile, so replaced or newly created files are seen too. Adding
+// an existing watch again is harmless.
+void add_watches(int fd, const generation &g, const walk_state &state)
+{
+  const uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF;
+  for (const std::string &dir : state.dirs)
+  {
+    inotify_add_watch(fd, dir.c_str(), mask);
+  }
+  for (const std::string &path : g.folders)
+  {
+    inotify_add_watch(fd, parent_directory(normalize_path(path)).c_str(), mask);
+  }
+  if (g.profile != "")
+  {
+    inotify_add_watch(fd, parent_directory(normalize_path(g.profile)).c_str(), mask);
+  }
+}
+
+// Blocks until something changes, then waits for the burst of events an
+// editor or build step produces to settle.
+void wait_for_changes(int fd)
+{
+  const int settle_ms = 100;
+  char events[64 * 1024];
+  pollfd p = {fd, POLLIN, 0};
+  int timeout = -1;
+  while (poll(&p, 1, timeout) > 0 || (timeout == -1 && errno == EINTR))
+  {
+    if (p.revents & POLLIN)
+    {
+      while (read(fd, events, sizeof(events)) > 0)
+      {
+      }
+      timeout = settle_ms;
+    }
+  }
+}
+
+// Rescans the inputs after every change. The scan only stats files; contents
+// are read and encoded again only for files whose stamp changed.
+void watch(BinFS::BinFS &binfs, const generation &g, walk_state state)
+{
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0)
+  {
+    throw std::runtime_error("inotify is not available!");
+  }
+  struct stat s;
+  file_stamp profile_stamp = g.profile != "" && stat(g.profile.c_str(), &s) == 0 ? stamp_of(s) : file_stamp();
+  printf("watching %zu files\n", state.stamps.size());
+  fflush(stdout);
+
+  while (true)
+  {
+    add_watches(fd, g, state);
+    wait_for_changes(fd);
+
+    try
+    {
+      // Directories that appeared are watched before their contents are
+      // trusted: scanning again after adding the watch catches files created
+      // in between, and anything later raises an event.
+      walk_state next = scan_inputs(g);
+      std::vector<std::string> watched(state.dirs);
+      while (next.dirs != watched)
+      {
+        add_watches(fd, g, next);
+        watched = next.dirs;
+        next = scan_inputs(g);
+      }
+      file_stamp next_profile = g.profile != "" && stat(g.profile.c_str(), &s) == 0 ? stamp_of(s) : file_stamp();
+
+      std::vector<std::string> changed;
+      for (const std::pair<const std::string, file_stamp> &file : next.stamps)
+      {
+        std::map<std::string, file_stamp>::const_iterator seen = state.stamps.find(file.first);
+        if (seen == state.stamps.end() || !(seen->second == file.second))
+        {
+          changed.push_back(relative_to_root(file.first, g.root));
+        }
+      }
+      bool removed = false;
+      for (const std::pair<const std::string, file_stamp> &file : state.stamps)
+      {
+        removed = removed || next.stamps.count(file.first) == 0;
+      }
+      if (changed.empty() && !removed && next.aliases == state.aliases && (g.profile == "" || next_profile == profile_stamp))
+      {
+        state.dirs = next.dirs;
+        continue;
+      }
+
+      for (const std::pair<std::string, std::string> &alias : state.aliases)
+      {
+        binfs.remove_file(relative_to_root(alias.first, g.root));
+      }
+      for (const std::string &name : changed)
+      {
+        binfs.remove_file(name);
+      }
+      binfs.add_files(changed);
+      for (const std::pair<std::string, std::string> &alias : next.aliases)
+      {
+        binfs.add_alias(relative_to_root(alias.first, g.root), relative_to_root(alias.second, g.root));
+      }
+      binfs.order_files(embedded_names(g, next.paths));
+
+      size_t written = write_outputs(binfs, g, next, true);
+      printf("%zu changed, %zu outputs rewritten\n", changed.size(), written);
+      fflush(stdout);
+      state = next;
+      profile_stamp = next_profile;
+    }
+    catch (const std::exception &e)
+    {
+      // Usually a file that vanished mid-save; the next event retries.
+      fprintf(stderr, "%s\n", e.what());
+    }
+  }
+}
+
+#endif
+
+int run(int argc, char *argv[])
+{
+  BinFS::set_jobs(parse_size_option(argc, argv, "-jobs", "0"));
+
+  generation g;
+  g.root = parse_option(argc, argv, "-root", "");
+  g.root = g.root == "" || normalize_path(g.root) == "." ? "" : normalize_path(g.root);
+  g.folders = parse_folders(argc, argv);
+  g.outfile = parse_option(argc, argv, "-outfile", "binfs.hpp");
+  g.sourcefile = parse_option(argc, argv, "-source", "");
+  g.packfile = parse_option(argc, argv, "-pack", "");
+  g.packname = parse_option(argc, argv, "-pack-name", g.packfile);
+  g.profile = parse_option(argc, argv, "-profile", "");
+  g.depfile = parse_option(argc, argv, "-depfile", "");
+  g.dict = parse_flag(argc, argv, "-dict");
+  g.dict_max_size = parse_size_option(argc, argv, "-dict-max-size", "4096");
+  BinFS::BinFS *binfs = new BinFS::BinFS(g.root);
+  std::string cachedir = parse_option(argc, argv, "-cache", "");
+  binfs->use_cache(cachedir);
+  bool minifying = parse_flag(argc, argv, "-minify");
+  if (minifying)
+  {
+    binfs->use_minify(split_list(parse_option(argc, argv, "-minify-exclude", "")));
+  }
+
+  if (parse_flag(argc, argv, "-brotli"))
+  {
+    binfs->add_encoding("br");
+  }
+  if (parse_flag(argc, argv, "-gzip"))
+  {
+    binfs->add_encoding("gzip");
+  }
+
+  walk_state state = scan_inputs(g);
+  binfs->add_files(embedded_names(g, state.paths));
+  for (const std::pair<std::string, std::string> &alias : state.aliases)
+  {
+    binfs->add_alias(relative_to_root(alias.first, g.root), relative_to_root(alias.second, g.root));
+  }
+
+  binfs->use_module(parse_option(argc, argv, "-module", ""));
+  binfs->use_constexpr_contents(parse_size_option(argc, argv, "-constexpr-max", "0"));
+  binfs->use_constexpr_index(parse_flag(argc, argv, "-constexpr-index"));
+
+  bool watching = parse_flag(argc, argv, "-watch");
+  write_outputs(*binfs, g, state, watching);
+  if (cachedir != "")
+  {
+    printf("cache: %zu hits, %zu misses\n", binfs->cache_hits(), binfs->cache_misses());
+  }
+  if (minifying)
+  {
+    print_minify_report(binfs->minify_report());
+  }
+
+  if (watching)
+  {
+#if defined(__linux__)
+    watch(*binfs, g, state);
+#else
+    throw std::runtime_error("-watch needs inotify, which this platform lacks!");
+#endif
+  }
 
   return 0;
 }
+
+int main(int argc, char *argv[])
+{
+  if (argc < 2)
+  {
+    usage(argv[0]);
+  }
+
+  try
+  {
+    return run(argc, argv);
+  }
+  catch (const std::exception &e)
+  {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+}
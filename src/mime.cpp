@@ -0,0 +1,77 @@
+#include "mime.h"
+
+#include <cctype>
+
+namespace BinFS
+{
+
+struct mime_mapping
+{
+  const char *extension;
+  const char *type;
+};
+
+static const mime_mapping mime_types[] = {
+    {"html", "text/html; charset=utf-8"},
+    {"htm", "text/html; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"js", "text/javascript; charset=utf-8"},
+    {"mjs", "text/javascript; charset=utf-8"},
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"webmanifest", "application/manifest+json"},
+    {"xml", "application/xml"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"md", "text/markdown; charset=utf-8"},
+    {"csv", "text/csv; charset=utf-8"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"avif", "image/avif"},
+    {"bmp", "image/bmp"},
+    {"ico", "image/x-icon"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"ttf", "font/ttf"},
+    {"otf", "font/otf"},
+    {"wasm", "application/wasm"},
+    {"pdf", "application/pdf"},
+    {"zip", "application/zip"},
+    {"gz", "application/gzip"},
+    {"mp3", "audio/mpeg"},
+    {"ogg", "audio/ogg"},
+    {"wav", "audio/wav"},
+    {"mp4", "video/mp4"},
+    {"webm", "video/webm"},
+};
+
+std::string guess_mime_type(const std::string &filename)
+{
+  size_t dot = filename.find_last_of('.');
+  size_t slash = filename.find_last_of("/\\");
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+  {
+    return "application/octet-stream";
+  }
+
+  std::string extension;
+  for (char c : filename.substr(dot + 1))
+  {
+    extension.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+  }
+
+  for (const mime_mapping &mapping : mime_types)
+  {
+    if (extension == mapping.extension)
+    {
+      return mapping.type;
+    }
+  }
+
+  return "application/octet-stream";
+}
+
+} // BinFS
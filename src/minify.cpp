@@ -0,0 +1,309 @@
+#include "minify.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace BinFS
+{
+
+static std::string extension_of(const std::string &filename)
+{
+  size_t dot = filename.find_last_of('.');
+  size_t slash = filename.find_last_of('/');
+  if (dot == std::string::npos || (slash != std::string::npos && slash > dot))
+  {
+    return "";
+  }
+  std::string extension = filename.substr(dot + 1);
+  for (char &c : extension)
+  {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return extension;
+}
+
+static bool is_space(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+static std::string minify_json(const std::string &in)
+{
+  std::string out;
+  out.reserve(in.length());
+  bool quoted = false;
+  for (size_t i = 0; in.length() > i; ++i)
+  {
+    char c = in[i];
+    if (quoted)
+    {
+      out.push_back(c);
+      if (c == '\\' && in.length() > i + 1)
+      {
+        out.push_back(in[++i]);
+      }
+      else if (c == '"')
+      {
+        quoted = false;
+      }
+    }
+    else if (!is_space(c))
+    {
+      quoted = c == '"';
+      out.push_back(c);
+    }
+  }
+
+  return quoted ? in : out;
+}
+
+// Whitespace is dropped next to these, where it never separates tokens.
+static bool css_separator(char c)
+{
+  return c == '{' || c == '}' || c == ';' || c == ',' || c == '>';
+}
+
+static std::string minify_css(const std::string &in)
+{
+  std::string out;
+  out.reserve(in.length());
+  bool space = false;
+  size_t i = 0;
+  while (in.length() > i)
+  {
+    char c = in[i];
+    if (c == '/' && in.compare(i, 2, "/*") == 0 && in.compare(i, 3, "/*!") != 0)
+    {
+      size_t end = in.find("*/", i + 2);
+      i = end == std::string::npos ? in.length() : end + 2;
+      space = true;
+      continue;
+    }
+    if (is_space(c))
+    {
+      space = true;
+      ++i;
+      continue;
+    }
+    if (c == '}' && !out.empty() && out.back() == ';')
+    {
+      out.pop_back();
+    }
+    if (space && !out.empty() && !css_separator(out.back()) && !css_separator(c))
+    {
+      out.push_back(' ');
+    }
+    space = false;
+
+    size_t end = i + 1;
+    if (c == '"' || c == '\'')
+    {
+      while (in.length() > end && in[end] != c)
+      {
+        end += in[end] == '\\' ? 2 : 1;
+      }
+      end = std::min(end + 1, in.length());
+    }
+    else if (c == '/' && in.compare(i, 3, "/*!") == 0)
+    {
+      size_t close = in.find("*/", i + 3);
+      end = close == std::string::npos ? in.length() : close + 2;
+    }
+    out.append(in, i, end - i);
+    i = end;
+  }
+
+  return out;
+}
+
+// Lower-cased name of the element whose tag starts at in[pos] == '<',
+// skipping the '/' of a closing tag.
+static std::string tag_name(const std::string &in, size_t pos)
+{
+  size_t begin = pos + 1 + (in.length() > pos + 1 && in[pos + 1] == '/' ? 1 : 0);
+  size_t end = begin;
+  while (in.length() > end && (std::isalnum(static_cast<unsigned char>(in[end])) || in[end] == '-' || in[end] == ':'))
+  {
+    ++end;
+  }
+  std::string name = in.substr(begin, end - begin);
+  for (char &c : name)
+  {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return name;
+}
+
+static size_t find_closing_tag(const std::string &in, const std::string &name, size_t pos)
+{
+  for (size_t i = in.find("</", pos); i != std::string::npos; i = in.find("</", i + 2))
+  {
+    if (tag_name(in, i) == name)
+    {
+      return i;
+    }
+  }
+  return in.length();
+}
+
+// Copies the tag starting at in[pos] with whitespace collapsed outside
+// attribute values and dropped before the closing bracket. Returns the
+// position after the tag.
+static size_t copy_tag(const std::string &in, size_t pos, std::string &out)
+{
+  char quote = 0;
+  size_t i = pos;
+  while (in.length() > i)
+  {
+    char c = in[i];
+    if (quote != 0 || c == '"' || c == '\'')
+    {
+      quote = quote == 0 ? c : c == quote ? 0 : quote;
+      out.push_back(c);
+      ++i;
+      continue;
+    }
+    if (is_space(c))
+    {
+      size_t end = i;
+      while (in.length() > end && is_space(in[end]))
+      {
+        ++end;
+      }
+      bool closes = in.length() == end || in[end] == '>' || in.compare(end, 2, "/>") == 0;
+      if (!closes && in[end] != '=' && out.back() != '=')
+      {
+        out.push_back(' ');
+      }
+      i = end;
+      continue;
+    }
+    out.push_back(c);
+    ++i;
+    if (c == '>')
+    {
+      break;
+    }
+  }
+
+  return i;
+}
+
+// HTML and SVG/XML. Whitespace runs in text collapse to one character; in
+// XML whitespace-only text between tags goes away entirely, except inside
+// <text> where it is rendered.
+static std::string minify_markup(const std::string &in, bool xml)
+{
+  std::string out;
+  out.reserve(in.length());
+  size_t text_depth = 0;
+  size_t i = 0;
+  while (in.length() > i)
+  {
+    char c = in[i];
+    char next = in.length() > i + 1 ? in[i + 1] : '\0';
+    if (c == '<' && in.compare(i, 4, "<!--") == 0)
+    {
+      size_t end = in.find("-->", i + 4);
+      end = end == std::string::npos ? in.length() : end + 3;
+      // Conditional comments are markup for old Internet Explorers.
+      if (!xml && in.compare(i, 5, "<!--[") == 0)
+      {
+        out.append(in, i, end - i);
+      }
+      i = end;
+      continue;
+    }
+    if (c == '<' && (next == '!' || next == '?'))
+    {
+      const char *close = in.compare(i, 9, "<![CDATA[") == 0 ? "]]>" : next == '?' ? "?>" : ">";
+      size_t end = in.find(close, i + 2);
+      end = end == std::string::npos ? in.length() : end + std::strlen(close);
+      out.append(in, i, end - i);
+      i = end;
+      continue;
+    }
+    if (c == '<' && (next == '/' || std::isalpha(static_cast<unsigned char>(next))))
+    {
+      std::string name = tag_name(in, i);
+      size_t end = copy_tag(in, i, out);
+      bool closing = next == '/';
+      bool empty = out.compare(out.length() - std::min<size_t>(2, out.length()), 2, "/>") == 0;
+      bool raw = name == "script" || name == "style" || (!xml && (name == "pre" || name == "textarea"));
+      if (!closing && !empty && raw)
+      {
+        size_t close = find_closing_tag(in, name, end);
+        out.append(in, end, close - end);
+        end = close;
+      }
+      else if (xml && name == "text" && !empty)
+      {
+        text_depth = closing ? (text_depth > 0 ? text_depth - 1 : 0) : text_depth + 1;
+      }
+      i = end;
+      continue;
+    }
+    if (is_space(c))
+    {
+      size_t end = i;
+      bool newline = false;
+      while (in.length() > end && is_space(in[end]))
+      {
+        newline = newline || in[end] == '\n';
+        ++end;
+      }
+      bool between_tags = (out.empty() || out.back() == '>') && (in.length() == end || in[end] == '<');
+      // A removed comment can leave two runs next to each other.
+      bool collapsed = out.empty() || is_space(out.back());
+      if (!collapsed && !(xml && text_depth == 0 && between_tags))
+      {
+        out.push_back(newline ? '\n' : ' ');
+      }
+      i = end;
+      continue;
+    }
+    out.push_back(c);
+    ++i;
+  }
+
+  return out;
+}
+
+bool can_minify(const std::string &filename)
+{
+  static const char *extensions[] = {"json", "webmanifest", "css", "html", "htm", "svg", "xml"};
+  std::string extension = extension_of(filename);
+  for (const char *known : extensions)
+  {
+    if (extension == known)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string minify(const std::string &filename, const std::string &in)
+{
+  std::string extension = extension_of(filename);
+  if (extension == "json" || extension == "webmanifest")
+  {
+    return minify_json(in);
+  }
+  if (extension == "css")
+  {
+    return minify_css(in);
+  }
+  if (extension == "html" || extension == "htm")
+  {
+    return minify_markup(in, false);
+  }
+  if (extension == "svg" || extension == "xml")
+  {
+    return minify_markup(in, true);
+  }
+  return in;
+}
+
+} // BinFS
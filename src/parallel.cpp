@@ -0,0 +1,79 @@
+#include "parallel.h"
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace BinFS
+{
+
+static size_t configured_jobs = 0;
+
+void set_jobs(size_t jobs)
+{
+  configured_jobs = jobs;
+}
+
+size_t jobs()
+{
+  if (configured_jobs != 0)
+  {
+    return configured_jobs;
+  }
+  unsigned cores = std::thread::hardware_concurrency();
+  return cores == 0 ? 1 : cores;
+}
+
+void parallel_for(size_t count, const std::function<void(size_t)> &fn)
+{
+  size_t workers = jobs() < count ? jobs() : count;
+  if (workers <= 1)
+  {
+    for (size_t i = 0; count > i; ++i)
+    {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next(0);
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  auto work = [&]() {
+    for (size_t i = next++; count > i; i = next++)
+    {
+      try
+      {
+        fn(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(error_mutex);
+        if (!error)
+        {
+          error = std::current_exception();
+        }
+        next = count;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 1; workers > t; ++t)
+  {
+    threads.emplace_back(work);
+  }
+  work();
+  for (std::thread &thread : threads)
+  {
+    thread.join();
+  }
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+}
+
+} // BinFS
@@ -0,0 +1,327 @@
+#include "reader.h"
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#ifdef BINFS_HAVE_IO_URING
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+namespace BinFS
+{
+
+static std::string read_portable(const std::string &path)
+{
+  std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+  if (!file.is_open())
+  {
+    throw std::runtime_error(path + " does not exists!");
+  }
+
+  std::string data(static_cast<size_t>(file.tellg()), '\0');
+  file.seekg(0, std::ios::beg);
+  file.read(&data[0], data.size());
+  data.resize(static_cast<size_t>(file.gcount()));
+  return data;
+}
+
+#ifdef BINFS_HAVE_IO_URING
+
+// Files handled per round trip; each one needs an openat and a statx slot.
+static const unsigned uring_batch = 256;
+// Largest single read request; bigger files are read in several pieces.
+static const uint64_t uring_max_read = 1u << 30;
+
+enum uring_op
+{
+  op_open = 0,
+  op_statx = 1,
+  op_read = 2,
+  op_close = 3
+};
+
+// Minimal io_uring driver on raw syscalls, so no liburing is needed.
+class uring
+{
+private:
+  int fd;
+  void *sq_ptr;
+  void *cq_ptr;
+  size_t sq_len;
+  size_t cq_len;
+  io_uring_sqe *sqes;
+  size_t sqes_len;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned *sq_array;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  io_uring_cqe *cqes;
+  unsigned tail;
+  unsigned queued;
+  unsigned inflight;
+
+public:
+  uring() : fd(-1), sq_ptr(MAP_FAILED), cq_ptr(MAP_FAILED), sq_len(0), cq_len(0), sqes(nullptr), sqes_len(0), tail(0), queued(0), inflight(0){};
+  ~uring();
+
+  bool setup(unsigned entries);
+  io_uring_sqe *prepare(uint8_t opcode, int target, uint64_t user_data);
+  template <typename F>
+  void run(F on_complete);
+};
+
+uring::~uring()
+{
+  if (sqes != nullptr)
+  {
+    munmap(sqes, sqes_len);
+  }
+  if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+  {
+    munmap(cq_ptr, cq_len);
+  }
+  if (sq_ptr != MAP_FAILED)
+  {
+    munmap(sq_ptr, sq_len);
+  }
+  if (fd >= 0)
+  {
+    close(fd);
+  }
+}
+
+bool uring::setup(unsigned entries)
+{
+  io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+  if (fd < 0)
+  {
+    return false;
+  }
+
+  sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single)
+  {
+    sq_len = cq_len = std::max(sq_len, cq_len);
+  }
+  sq_ptr = mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED)
+  {
+    return false;
+  }
+  cq_ptr = single ? sq_ptr : mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  if (cq_ptr == MAP_FAILED)
+  {
+    return false;
+  }
+  sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+  void *s = mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (s == MAP_FAILED)
+  {
+    return false;
+  }
+  sqes = static_cast<io_uring_sqe *>(s);
+
+  char *sq = static_cast<char *>(sq_ptr);
+  char *cq = static_cast<char *>(cq_ptr);
+  sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+  tail = *sq_tail;
+  return true;
+}
+
+io_uring_sqe *uring::prepare(uint8_t opcode, int target, uint64_t user_data)
+{
+  if (queued + inflight > sq_mask)
+  {
+    throw std::runtime_error("io_uring submission queue is full!");
+  }
+  unsigned index = tail & sq_mask;
+  io_uring_sqe *sqe = &sqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = opcode;
+  sqe->fd = target;
+  sqe->user_data = user_data;
+  sq_array[index] = index;
+  ++tail;
+  ++queued;
+  return sqe;
+}
+
+// Submits everything prepared and reaps completions until nothing is in
+// flight; on_complete may prepare follow-up requests.
+template <typename F>
+void uring::run(F on_complete)
+{
+  while (queued > 0 || inflight > 0)
+  {
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+    long submitted = syscall(__NR_io_uring_enter, fd, queued, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+    if (submitted < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      throw std::runtime_error("io_uring_enter failed!");
+    }
+    queued -= static_cast<unsigned>(submitted);
+    inflight += static_cast<unsigned>(submitted);
+
+    unsigned head = *cq_head;
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+    {
+      io_uring_cqe cqe = cqes[head & cq_mask];
+      __atomic_store_n(cq_head, ++head, __ATOMIC_RELEASE);
+      --inflight;
+      on_complete(cqe.user_data, cqe.res);
+    }
+  }
+}
+
+static bool unsupported_result(int res)
+{
+  return res == -EINVAL || res == -EOPNOTSUPP;
+}
+
+// Returns false when the kernel cannot run the batch, before any contents
+// are relied upon, so the caller can redo everything the portable way.
+static bool read_uring(const std::vector<std::string> &paths, std::vector<std::string> &contents)
+{
+  uring ring;
+  if (!ring.setup(2 * uring_batch))
+  {
+    return false;
+  }
+
+  for (size_t begin = 0; paths.size() > begin; begin += uring_batch)
+  {
+    size_t count = std::min<size_t>(uring_batch, paths.size() - begin);
+    std::vector<int> fds(count, -1);
+    std::vector<struct statx> stats(count);
+    std::vector<uint64_t> done(count, 0);
+    bool unsupported = false;
+    std::string failed;
+
+    for (size_t i = 0; count > i; ++i)
+    {
+      io_uring_sqe *sqe = ring.prepare(IORING_OP_OPENAT, AT_FDCWD, i << 2 | op_open);
+      sqe->addr = reinterpret_cast<uint64_t>(paths[begin + i].c_str());
+      sqe->open_flags = O_RDONLY | O_CLOEXEC;
+      sqe = ring.prepare(IORING_OP_STATX, AT_FDCWD, i << 2 | op_statx);
+      sqe->addr = reinterpret_cast<uint64_t>(paths[begin + i].c_str());
+      sqe->len = STATX_SIZE;
+      sqe->off = reinterpret_cast<uint64_t>(&stats[i]);
+    }
+    ring.run([&](uint64_t data, int res) {
+      size_t i = static_cast<size_t>(data >> 2);
+      if (res < 0)
+      {
+        unsupported = unsupported || unsupported_result(res);
+        failed = paths[begin + i];
+      }
+      else if ((data & 3) == op_open)
+      {
+        fds[i] = res;
+      }
+    });
+    if (unsupported || !failed.empty())
+    {
+      for (int fd : fds)
+      {
+        if (fd >= 0)
+        {
+          close(fd);
+        }
+      }
+      if (unsupported)
+      {
+        return false;
+      }
+      throw std::runtime_error(failed + " does not exists!");
+    }
+
+    auto read_next = [&](size_t i) {
+      std::string &data = contents[begin + i];
+      io_uring_sqe *sqe = ring.prepare(IORING_OP_READ, fds[i], i << 2 | op_read);
+      sqe->addr = reinterpret_cast<uint64_t>(&data[0] + done[i]);
+      sqe->len = static_cast<uint32_t>(std::min<uint64_t>(data.size() - done[i], uring_max_read));
+      sqe->off = done[i];
+    };
+    for (size_t i = 0; count > i; ++i)
+    {
+      contents[begin + i].assign(static_cast<size_t>(stats[i].stx_size), '\0');
+      if (!contents[begin + i].empty())
+      {
+        read_next(i);
+      }
+    }
+    ring.run([&](uint64_t data, int res) {
+      size_t i = static_cast<size_t>(data >> 2);
+      if (res < 0)
+      {
+        failed = paths[begin + i];
+        return;
+      }
+      done[i] += static_cast<uint64_t>(res);
+      if (res == 0)
+      {
+        // The file shrank since statx; keep what was there.
+        contents[begin + i].resize(static_cast<size_t>(done[i]));
+      }
+      else if (contents[begin + i].size() > done[i])
+      {
+        read_next(i);
+      }
+    });
+
+    for (size_t i = 0; count > i; ++i)
+    {
+      ring.prepare(IORING_OP_CLOSE, fds[i], i << 2 | op_close);
+    }
+    ring.run([](uint64_t, int) {});
+    if (!failed.empty())
+    {
+      throw std::runtime_error("cannot read " + failed);
+    }
+  }
+
+  return true;
+}
+
+#endif
+
+void read_files(const std::vector<std::string> &paths, std::vector<std::string> &contents)
+{
+  contents.assign(paths.size(), std::string());
+#ifdef BINFS_HAVE_IO_URING
+  if (read_uring(paths, contents))
+  {
+    return;
+  }
+#endif
+  for (size_t i = 0; paths.size() > i; ++i)
+  {
+    contents[i] = read_portable(paths[i]);
+  }
+}
+
+} // BinFS
@@ -0,0 +1,57 @@
+# Generates the same tree twice, with the files created in opposite orders
+# (so readdir returns them differently on most filesystems) and the input
+# path spelled differently, and requires byte-identical outputs.
+#
+#   cmake -DBINFS=<binfs executable> -DWORK=<scratch directory> -P reproducible.cmake
+
+cmake_minimum_required(VERSION 3.7)
+
+set(names "b.txt" "a.txt" "B.txt" "sub/d.txt" "sub/c.txt" "sub-x.txt" "with space.txt" "z/deep/e.bin")
+set(reversed ${names})
+list(REVERSE reversed)
+
+file(REMOVE_RECURSE ${WORK})
+foreach (run forward reverse)
+  set(dir ${WORK}/${run})
+  file(MAKE_DIRECTORY ${dir}/data)
+  if (run STREQUAL "forward")
+    set(order ${names})
+    set(input data)
+  else()
+    set(order ${reversed})
+    set(input ./data//sub/..)
+  endif()
+  foreach (name ${order})
+    file(WRITE "${dir}/data/${name}" "contents of ${name}\n")
+  endforeach()
+
+  execute_process(COMMAND ${BINFS} -outfile embedded.hpp -source embedded.cpp -depfile embedded.d ${input}
+    WORKING_DIRECTORY ${dir} RESULT_VARIABLE rc OUTPUT_QUIET)
+  if (NOT rc EQUAL 0)
+    message(FATAL_ERROR "binfs failed in ${dir}: ${rc}")
+  endif()
+  execute_process(COMMAND ${BINFS} -gzip -pack assets.pack -outfile pack.hpp ${input}
+    WORKING_DIRECTORY ${dir} RESULT_VARIABLE rc OUTPUT_QUIET)
+  if (NOT rc EQUAL 0)
+    message(FATAL_ERROR "binfs -pack failed in ${dir}: ${rc}")
+  endif()
+endforeach()
+
+# The depfile names inputs by absolute path, which includes the run directory.
+file(READ ${WORK}/forward/embedded.d forward)
+file(READ ${WORK}/reverse/embedded.d reverse)
+string(REPLACE "${WORK}/forward/" "" forward "${forward}")
+string(REPLACE "${WORK}/reverse/" "" reverse "${reverse}")
+if (NOT forward STREQUAL reverse)
+  message(FATAL_ERROR "embedded.d differs between creation orders")
+endif()
+
+foreach (output embedded.hpp embedded.cpp pack.hpp assets.pack)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${WORK}/forward/${output} ${WORK}/reverse/${output}
+    RESULT_VARIABLE rc)
+  if (NOT rc EQUAL 0)
+    message(FATAL_ERROR "${output} differs between creation orders")
+  endif()
+endforeach()
+
+file(REMOVE_RECURSE ${WORK})